@@ -0,0 +1,79 @@
+// Copyright 2018 Apex.AI, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t cache_line = 64;
+constexpr std::size_t nesting = 16;
+
+/// Exception filling exactly one cache line if it is aligned to one.
+struct Payload {
+  std::uint64_t data[cache_line / sizeof (std::uint64_t)];
+};
+
+/// Addresses of the thrown objects, recorded by the first run.
+std::vector<std::uintptr_t> g_addresses;
+
+/// Throws \param depth nested payloads, copies every caught one and destroys it.
+std::uint64_t nested_copy(const bool record, const std::size_t depth = 0) {
+  if (depth == nesting) {
+    return 0;
+  }
+  try {
+    throw Payload{{depth, depth, depth, depth, depth, depth, depth, depth}};
+  } catch (const Payload &e) {
+    if (record) {
+      g_addresses.push_back(reinterpret_cast<std::uintptr_t>(&e));
+    }
+    const auto copy = e;
+    return copy.data[0] + copy.data[7] + nested_copy(record, depth + 1);
+  }
+}
+
+}
+
+/** Measures throwing, copying and destroying one cache line sized exception. The exception
+ *  object only stays on one cache line if the pool aligns it to one.
+ */
+int main() {
+  constexpr std::size_t iterations = 20000;
+  nested_copy(true);
+  std::size_t split = std::size_t();
+  for (const auto address : g_addresses) {
+    if (address % cache_line + sizeof (Payload) > cache_line) {
+      ++split;
+    }
+  }
+
+  std::uint64_t checksum = std::uint64_t();
+  const auto t_start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    checksum += nested_copy(false);
+  }
+  const auto t_end = std::chrono::steady_clock::now();
+
+  std::cout << std::fixed << std::setprecision(2) <<
+    "[ OBJECT ALIGNMENT ] " << EXCEPTION_MEMORY__CXX_OBJECT_ALIGNMENT << "\n" <<
+    "[ SPLIT LINE OBJECTS ] " << split << " of " << g_addresses.size() << "\n" <<
+    "[ THROW+COPY+DESTROY ] " <<
+      std::chrono::duration<double, std::nano>(t_end - t_start).count() /
+      (iterations * nesting) << " ns\n" <<
+    "[ CHECKSUM ] " << checksum << std::endl;
+}
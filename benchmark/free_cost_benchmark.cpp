@@ -0,0 +1,55 @@
+// Copyright 2018 Apex.AI, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <cxxabi.h>
+
+/** Measures the cost of handing exception memory out of and back to the pool while half of the
+ *  pool is in use. The free cost should not depend on EXCEPTION_MEMORY__CXX_POOL_SIZE.
+ */
+int main() {
+  constexpr std::size_t thrown_size = 64;
+  constexpr std::size_t iterations = 32;
+  constexpr std::size_t in_flight = EXCEPTION_MEMORY__CXX_POOL_SIZE / 2;
+
+  std::vector<void *> exceptions(in_flight);
+  std::chrono::duration<double, std::nano> allocate_time{0};
+  std::chrono::duration<double, std::nano> free_time{0};
+
+  for (std::size_t i = 0; i < iterations; ++i) {
+    const auto t_start = std::chrono::steady_clock::now();
+    for (auto &elem : exceptions) {
+      elem = abi::__cxa_allocate_exception(thrown_size);
+    }
+    const auto t_allocated = std::chrono::steady_clock::now();
+    // Free in reverse order, as stack unwinding does.
+    for (auto it = exceptions.rbegin(); it != exceptions.rend(); ++it) {
+      abi::__cxa_free_exception(*it);
+    }
+    const auto t_freed = std::chrono::steady_clock::now();
+
+    allocate_time += t_allocated - t_start;
+    free_time += t_freed - t_allocated;
+  }
+
+  const auto operations = static_cast<double>(iterations * in_flight);
+  std::cout << std::fixed << std::setprecision(2) <<
+    "[ POOL SIZE ] " << EXCEPTION_MEMORY__CXX_POOL_SIZE << "\n" <<
+    "[ IN FLIGHT ] " << in_flight << "\n" <<
+    "[ ALLOCATE ] " << allocate_time.count() / operations << " ns\n" <<
+    "[ FREE ] " << free_time.count() / operations << " ns" << std::endl;
+}
@@ -0,0 +1,54 @@
+// Copyright 2018 Apex.AI, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <cxxabi.h>
+
+#include "static_exception.hpp"
+
+/** Measures handing exception memory out of and back to the pool, and a full throw and catch,
+ *  with the memory pool linked as shared library, as static library or compiled into the
+ *  executable. Only the latter two can inline the fast path of the pool.
+ */
+int main() {
+  constexpr std::size_t thrown_size = 64;
+  constexpr std::size_t iterations = 1000000;
+
+  const auto t_start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    abi::__cxa_free_exception(abi::__cxa_allocate_exception(thrown_size));
+  }
+  const auto t_allocated = std::chrono::steady_clock::now();
+  std::size_t caught = std::size_t();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    try {
+      throw i;
+    } catch (const std::size_t &e) {
+      caught += e;
+    }
+  }
+  const auto t_thrown = std::chrono::steady_clock::now();
+
+  std::cout << std::fixed << std::setprecision(2) <<
+    "[ ALLOCATE+FREE ] " <<
+      std::chrono::duration<double, std::nano>(t_allocated - t_start).count() / iterations <<
+      " ns\n" <<
+    "[ THROW+CATCH ] " <<
+      std::chrono::duration<double, std::nano>(t_thrown - t_allocated).count() / iterations <<
+      " ns\n" <<
+    "[ USED SEGMENTS ] " << __get_exception_memory_pool_used_segments() << "\n" <<
+    "[ CHECKSUM ] " << caught << std::endl;
+}
@@ -0,0 +1,93 @@
+// Copyright 2018 Apex.AI, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t max_depth = 64;
+/// Number of sets of a 32 KiB, 8-way L1 data cache with 64 byte lines.
+constexpr std::size_t l1_sets = 64;
+
+/// Exception of the same size as the one of the tests.
+class NestedException {
+  public:
+  std::size_t m_dummy_data[64];
+};
+
+/// Addresses of the exceptions in flight at every depth, recorded by the first nesting.
+std::vector<std::uintptr_t> g_addresses;
+
+/// Nests throws the same way recursive_except() of the tests does.
+void recursive_except(const bool record, const std::size_t depth = 0) {
+  if (depth > max_depth) {
+    return;
+  }
+  try {
+    throw NestedException();
+  } catch (const NestedException &e) {
+    if (record) {
+      g_addresses.push_back(reinterpret_cast<std::uintptr_t>(&e));
+    }
+    recursive_except(record, depth + 1);
+  }
+}
+
+/// \return The average time in ns of one throw/catch of a nesting on \param num_threads threads.
+double nested_throw(const std::size_t num_threads) {
+  constexpr std::size_t iterations = 2000;
+  std::vector<std::thread> threads(num_threads);
+  const auto t_start = std::chrono::steady_clock::now();
+  for (auto &elem : threads) {
+    elem = std::thread([]() {
+      for (std::size_t i = 0; i < iterations; ++i) {
+        recursive_except(false);
+      }
+    });
+  }
+  for (auto &elem : threads) {
+    elem.join();
+  }
+  const auto t_end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t_end - t_start).count() /
+      (iterations * num_threads * (max_depth + 1));
+}
+
+}
+
+/** Measures nested throws as done by recursive_except() of the tests. All exceptions of a
+ *  nesting are alive at the same time, so their headers compete for the same cache sets unless
+ *  the segments are coloured.
+ */
+int main() {
+  recursive_except(true);
+  std::set<std::size_t> sets;
+  for (const auto address : g_addresses) {
+    sets.insert(address / 64 % l1_sets);
+  }
+  std::cout << std::fixed << std::setprecision(2) <<
+    "[ NESTED HEADERS ] " << g_addresses.size() << "\n" <<
+    "[ DISTINCT L1 SETS ] " << sets.size() << " of " << l1_sets << "\n";
+  for (const auto num_threads : {1, 4, 16}) {
+    std::cout << "[ NESTED THROW+CATCH " << num_threads << " THREADS ] " <<
+      nested_throw(num_threads) << " ns\n";
+  }
+  std::cout << std::flush;
+}
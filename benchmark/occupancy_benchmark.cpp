@@ -0,0 +1,112 @@
+// Copyright 2018 Apex.AI, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <cxxabi.h>
+#include "static_exception.hpp"
+
+namespace {
+
+constexpr std::size_t thrown_size = 64;
+constexpr std::size_t pool_size = EXCEPTION_MEMORY__CXX_POOL_SIZE;
+
+/// \return The average time in ns of one allocate/free pair while \param occupied segments are held.
+double allocate_free_pair(const std::size_t occupied) {
+  constexpr std::size_t iterations = 100000;
+  std::vector<void *> held(occupied);
+  for (auto &elem : held) {
+    elem = abi::__cxa_allocate_exception(thrown_size);
+  }
+
+  const auto t_start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    abi::__cxa_free_exception(abi::__cxa_allocate_exception(thrown_size));
+  }
+  const auto t_end = std::chrono::steady_clock::now();
+
+  for (auto elem : held) {
+    abi::__cxa_free_exception(elem);
+  }
+  return std::chrono::duration<double, std::nano>(t_end - t_start).count() / iterations;
+}
+
+/// \return The average time in ns of one throw/catch cycle with \param num_threads threads.
+double throw_catch_cycle(const std::size_t num_threads) {
+  constexpr std::size_t iterations = 20000;
+  std::vector<std::thread> threads(num_threads);
+  const auto t_start = std::chrono::steady_clock::now();
+  for (auto &elem : threads) {
+    elem = std::thread([]() {
+      for (std::size_t i = 0; i < iterations; ++i) {
+        try {
+          throw std::array<char, thrown_size>();
+        } catch (...) {
+        }
+      }
+    });
+  }
+  for (auto &elem : threads) {
+    elem.join();
+  }
+  const auto t_end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t_end - t_start).count() /
+      (iterations * num_threads);
+}
+
+}
+
+/** Measures how the allocation engine copes with a busy pool: single allocate/free pairs while a
+ *  growing part of the pool is held, and throw/catch cycles on several threads.
+ */
+int main() {
+#ifdef EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY
+  // Builds the pool the other variants get at compile time at runtime.
+  if (!exception_memory::configure_pool({1024, pool_size, 8})) {
+    return 1;
+  }
+#endif
+  std::cout << std::fixed << std::setprecision(2);
+  for (const auto percent : {0, 50, 90, 99}) {
+    std::cout << "[ ALLOCATE+FREE " << percent << "% OCCUPIED ] " <<
+      allocate_free_pair(pool_size * percent / 100) << " ns\n";
+  }
+  for (const auto num_threads : {1, 4, 16}) {
+    std::cout << "[ THROW+CATCH " << num_threads << " THREADS ] " <<
+      throw_catch_cycle(num_threads) << " ns\n";
+  }
+  const auto stats = __get_exception_memory_pool_thread_cache_statistics();
+  const auto allocations = stats.allocate_hits + stats.allocate_misses;
+  const auto frees = stats.free_hits + stats.free_misses;
+  if (allocations > 0 && frees > 0) {
+    std::cout <<
+      "[ THREAD CACHE ALLOCATE HIT RATE ] " << 100.0 * stats.allocate_hits / allocations << " %\n" <<
+      "[ THREAD CACHE FREE HIT RATE ] " << 100.0 * stats.free_hits / frees << " %\n";
+  }
+  const auto shards = __get_exception_memory_pool_shard_statistics();
+  if (shards.local_hits + shards.steals > 0) {
+    std::cout << "[ SHARD LOCAL HIT RATE ] " <<
+      100.0 * shards.local_hits / (shards.local_hits + shards.steals) << " %\n";
+  }
+  const auto cpus = __get_exception_memory_pool_per_cpu_statistics();
+  if (cpus.local_hits + cpus.refills + cpus.steals > 0) {
+    std::cout << "[ PER CPU LOCAL HIT RATE ] " <<
+      100.0 * cpus.local_hits / (cpus.local_hits + cpus.refills + cpus.steals) << " %\n";
+  }
+  std::cout << std::flush;
+}
@@ -0,0 +1,133 @@
+// Copyright 2018 Apex.AI, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "exception_memory_pool.hpp"
+
+namespace {
+
+using namespace exception_memory::__cxx;
+
+constexpr std::size_t segment_size = 1024;
+constexpr std::size_t threads = 4;
+constexpr std::size_t iterations = 200000;
+
+using Sharded = ShardedSearch<16>;
+using ThreadCached = ThreadCachedSearch<FreelistSearch, 8, 256>;
+using PerCpu = PerCpuSearch<ProbingSearch, 256>;
+using Lazy = LazyCommitBacking<64 * 1024>;
+
+/// Printed name of a policy.
+template <typename Policy>
+struct Name;
+template <> struct Name<ProbingSearch> { static constexpr const char *value = "probing"; };
+template <> struct Name<FreelistSearch> { static constexpr const char *value = "freelist"; };
+template <> struct Name<Sharded> { static constexpr const char *value = "sharded"; };
+template <> struct Name<ThreadCached> { static constexpr const char *value = "thread cached"; };
+template <> struct Name<PerCpu> { static constexpr const char *value = "per cpu"; };
+template <> struct Name<ThreadStartIndex> { static constexpr const char *value = "thread start"; };
+template <> struct Name<FirstStartIndex> { static constexpr const char *value = "first start"; };
+template <> struct Name<StaticBacking> { static constexpr const char *value = "static"; };
+template <> struct Name<HeapBacking> { static constexpr const char *value = "heap"; };
+template <> struct Name<HugePageBacking> { static constexpr const char *value = "huge pages"; };
+template <> struct Name<Lazy> { static constexpr const char *value = "lazy commit"; };
+
+/// List of the policies of one kind.
+template <typename... Policies>
+struct List {};
+
+using Searches = List<ProbingSearch, FreelistSearch, Sharded, ThreadCached, PerCpu>;
+using StartIndices = List<ThreadStartIndex, FirstStartIndex>;
+using Backings = List<StaticBacking, HeapBacking, HugePageBacking, Lazy>;
+
+/** Measures allocate/deallocate pairs of \param threads threads on a pool of Size segments,
+ *  half of which are in use, and prints the average time of a pair.
+ */
+template <typename Policies, std::size_t Size = 8192>
+void run(const char *name) {
+  using Pool = SegmentPool<segment_size, Size, Policies>;
+  const auto pool = std::make_unique<Pool>();
+  std::vector<void *> occupied;
+  for (std::size_t i = 0; i < Size / 2; ++i) {
+    occupied.push_back(pool->allocate());
+  }
+
+  const auto t_start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (std::size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&pool]() {
+      for (std::size_t i = 0; i < iterations; ++i) {
+        const auto ptr = pool->allocate();
+        if (ptr != nullptr) {
+          pool->deallocate(ptr);
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  const auto t_end = std::chrono::steady_clock::now();
+
+  for (const auto ptr : occupied) {
+    pool->deallocate(ptr);
+  }
+  std::cout << std::fixed << std::setprecision(2) << "[ " << std::left << std::setw(52) <<
+    name << " ] " << std::right << std::setw(8) <<
+    std::chrono::duration<double, std::nano>(t_end - t_start).count() / iterations << " ns\n";
+}
+
+/// Runs the pool with \tparam Search, \tparam StartIndex and \tparam Backing with and without
+/// statistics.
+template <typename Search, typename StartIndex, typename Backing>
+void run_statistics() {
+  const auto name = std::string(Name<Search>::value) + "/" + Name<StartIndex>::value + "/" +
+    Name<Backing>::value;
+  run<PoolPolicies<Search, StartIndex, Backing, true>>((name + "/stats").c_str());
+  run<PoolPolicies<Search, StartIndex, Backing, false>>((name + "/no stats").c_str());
+}
+
+template <typename Search, typename StartIndex, typename... Backing>
+void run_backings(List<Backing...>) {
+  (run_statistics<Search, StartIndex, Backing>(), ...);
+}
+
+template <typename Search, typename... StartIndex>
+void run_start_indices(List<StartIndex...>) {
+  (run_backings<Search, StartIndex>(Backings{}), ...);
+}
+
+template <typename... Search>
+void run_searches(List<Search...>) {
+  (run_start_indices<Search>(StartIndices{}), ...);
+}
+
+}
+
+/** Instantiates the segment pool with every combination of the policy lists side by side. The
+ *  segment counts, and with them the bitmap word counts, are powers of two unless noted
+ *  otherwise.
+ */
+int main() {
+  run_searches(Searches{});
+  run<PoolPolicies<ProbingSearch, ThreadStartIndex, HeapBacking, true>, 8000>(
+      "probing/thread start/heap/stats/8000 segments");
+  std::cout << std::flush;
+}
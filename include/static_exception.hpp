@@ -0,0 +1,480 @@
+// Copyright 2018 Apex.AI, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STATIC_EXCEPTION_STATIC_EXCEPTION_HPP
+#define STATIC_EXCEPTION_STATIC_EXCEPTION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+namespace exception_memory {
+
+/// Counters of the per thread segment caches, summed up over all threads.
+struct ThreadCacheStatistics {
+  /// Allocations served from the thread cache.
+  std::uint64_t allocate_hits;
+  /// Allocations which had to refill the thread cache from the shared pool.
+  std::uint64_t allocate_misses;
+  /// Frees kept in the thread cache.
+  std::uint64_t free_hits;
+  /// Frees which had to spill part of the thread cache to the shared pool.
+  std::uint64_t free_misses;
+};
+
+/// Counters of the sharded segment allocators, summed up over all shards.
+struct ShardStatistics {
+  /// Segments taken from the shard of the allocating thread.
+  std::uint64_t local_hits;
+  /// Segments stolen from other shards because the shard of the allocating thread was exhausted.
+  std::uint64_t steals;
+};
+
+/// Counters of the per CPU freelists, summed up over all CPUs.
+struct PerCpuStatistics {
+  /// Allocations served from the freelist of the current CPU.
+  std::uint64_t local_hits;
+  /// Allocations which had to refill the freelist of the current CPU from the shared pool.
+  std::uint64_t refills;
+  /// Allocations which took a segment from the freelist of another CPU.
+  std::uint64_t steals;
+};
+
+/// Counters of the NUMA placement, summed up over all pools.
+struct NumaStatistics {
+  /// Allocations served from the partition of the node the thread runs on.
+  std::uint64_t local_hits;
+  /// Allocations served from another node because the local partition was exhausted.
+  std::uint64_t remote_hits;
+  /// Partitions whose memory is bound to their node.
+  std::uint64_t bound_nodes;
+  /// Partitions of existing nodes whose memory could not be bound.
+  std::uint64_t bind_failures;
+};
+
+/// Number of used segments in the partitions of one NUMA node.
+struct NumaNodeOccupancy {
+  std::size_t node;
+  std::size_t used_segments;
+};
+
+/** Overrides the NUMA node of the first \param cpus CPUs with \param cpu_to_node. By default the
+ *  mapping is read from sysfs. Intended to test the NUMA placement on single node machines, memory
+ *  already bound to a node is not moved.
+ */
+void set_numa_topology(const std::uint16_t *cpu_to_node, std::size_t cpus) noexcept;
+
+/// Number of memory pool slabs per kind of backing memory.
+struct BackingStatistics {
+  /// Slabs allocated from the heap.
+  std::uint64_t heap_slabs;
+  /// Slabs mapped with regular pages because no huge pages were available.
+  std::uint64_t page_slabs;
+  /// Slabs mapped with reserved huge pages.
+  std::uint64_t huge_page_slabs;
+  /// Slabs mapped with regular pages the kernel was asked to back with transparent huge pages.
+  std::uint64_t transparent_huge_page_slabs;
+  /// Slabs in static storage, which need no allocation at startup.
+  std::uint64_t static_slabs;
+};
+
+/// Memory of the memory pool, summed up over all slabs.
+struct CommitStatistics {
+  /// Bytes of address space reserved for the memory pool.
+  std::size_t reserved_bytes;
+  /// Bytes of the reserved address space which are committed. Equal to reserved_bytes unless
+  /// EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE is set.
+  std::size_t committed_bytes;
+};
+
+/// Result of faulting in and locking the memory pool.
+struct PrefaultResult {
+  /// Bytes of the memory pool which were faulted in.
+  std::size_t prefaulted_bytes;
+  /// Bytes of the memory pool which are locked in RAM.
+  std::size_t locked_bytes;
+  /// errno of the first failed mlock call, e.g. ENOMEM if RLIMIT_MEMLOCK is too low. 0 if the
+  /// whole memory pool is locked.
+  int lock_error;
+};
+
+/** Faults in every page of the memory pool and locks it in RAM with mlock, so throwing never
+ *  takes a page fault. Call it during the initialization of real-time applications. Can be
+ *  called while exceptions are in flight.
+ *  \return How much of the memory pool was prefaulted and locked.
+ */
+PrefaultResult prefault_and_lock() noexcept;
+
+/** Sets up the memory pool state of the calling thread and touches the segments it will use
+ *  first. Call it from every real-time thread before it enters its deterministic section, and
+ *  again after changing its scheduling policy, which is otherwise detected once per thread.
+ */
+void warm_up_thread() noexcept;
+
+/** Returns the pages of free segments to the kernel, e.g. after a burst of exceptions. Every
+ *  pool keeps as many segments resident as its high-water mark of used segments, which follows
+ *  the peak since the previous call and halves with every call. Can be called while exceptions
+ *  are in flight, e.g. periodically from a housekeeping thread. Allocations never wait for the
+ *  trim of a segment pool, only large exceptions wait for the one of the arena. Released pages
+ *  fault in again on their next use, chunks of lazily committed pools are committed and
+ *  prefaulted again.
+ *  \return The number of bytes returned to the kernel.
+ */
+std::size_t trim() noexcept;
+
+/// Geometry of the exception memory pool.
+struct PoolGeometry {
+  /// Size of every segment including the internal exception header.
+  std::size_t segment_size;
+  /// Number of segments.
+  std::size_t segments;
+  /// Alignment of the segments.
+  std::size_t alignment;
+};
+
+/** Replaces the geometry of the memory pool. Only supported with
+ *  EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY and must be called before the first exception is
+ *  thrown, at least before other threads throw. Overrides the geometry read from the environment.
+ *  \return false if the geometry is fixed at compile time, invalid or exceptions are in flight.
+ */
+bool configure_pool(const PoolGeometry &geometry) noexcept;
+
+/// \return The geometry of the memory pool, of its largest size class if there are several.
+PoolGeometry pool_geometry() noexcept;
+
+/// Occupancy of one size class of the memory pool or of the dependent exception pool.
+struct SizeClassStatistics {
+  /// Size of every segment including the internal exception header.
+  std::size_t segment_size;
+  /// Number of segments.
+  std::size_t segments;
+  /// Number of segments in use.
+  std::size_t used_segments;
+};
+
+/// Occupancy and counters of the arena for exceptions too large for the size classes.
+struct LargeExceptionStatistics {
+  /// Size of the arena in bytes, 0 if EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE is not set.
+  std::size_t arena_bytes;
+  /// Bytes of the blocks in use, including the rounding up to whole blocks.
+  std::size_t used_bytes;
+  /// Allocations served by the arena.
+  std::uint64_t allocations;
+  /// Allocations the arena could not serve, which were passed on to the fallback chain.
+  std::uint64_t failures;
+};
+
+/// Growth of the memory pool in elastic mode.
+struct ElasticStatistics {
+  /// Slabs added to the memory pool, at most EXCEPTION_MEMORY__CXX_ELASTIC_SLABS.
+  std::size_t slabs;
+  /// Segments of the memory pool including the added slabs, 0 until the helper thread runs.
+  std::size_t capacity;
+  /// Segments in use, counted against the watermark.
+  std::size_t used_segments;
+  /// Times the used segments crossed the watermark and woke the helper thread.
+  std::uint64_t growth_requests;
+  /// Slabs the helper thread could not map.
+  std::uint64_t growth_failures;
+  /// Allocations served by the added slabs.
+  std::uint64_t allocations;
+};
+
+/** Starts the low priority helper thread of the elastic mode, see
+ *  EXCEPTION_MEMORY__CXX_ELASTIC_SLABS. Once the used segments cross the watermark it maps a
+ *  prefaulted slab and adds it to the memory pool, the throwing thread only wakes it. Call it
+ *  once during initialization, e.g. at the start of main. The helper thread is not inherited by
+ *  forked processes.
+ *  \return false if the elastic mode is disabled, the helper thread was started before or could
+ *  not be started.
+ */
+bool start_elastic_growth() noexcept;
+
+/** Sets the number of segments reserved for the calling thread to \param segments, e.g. for a
+ *  critical thread during its initialization. Reserving claims the segments from the largest
+ *  size class right away and the thread allocates from them first, so they are available to it
+ *  no matter how many exceptions other threads have in flight, and the thread can have at least
+ *  as many exceptions in flight as it reserved. The reservation covers the exceptions which fit
+ *  into the largest size class, not the dependent exceptions of std::rethrow_exception. Requires
+ *  EXCEPTION_MEMORY__CXX_THREAD_QUOTA. The reservation is dropped when the thread exits, 0 drops
+ *  it right away.
+ *  \return false if the thread quotas are disabled, the calling thread shares its quota with
+ *  other threads or the largest size class has not enough free segments, the reservation is left
+ *  unchanged then.
+ */
+bool reserve_thread_segments(std::size_t segments) noexcept;
+
+/// \return The number of segments reserved for the calling thread.
+std::size_t thread_reserved_segments() noexcept;
+
+/** Reserves segments for the calling thread for the duration of a scope, on top of its current
+ *  reservation, e.g. for an upcoming critical section. Scopes of one thread must be nested.
+ */
+class ReserveScope {
+  public:
+  /// Reserves \param segments additional segments for the calling thread.
+  explicit ReserveScope(std::size_t segments) noexcept;
+  /// Restores the reservation of the calling thread before the scope.
+  ~ReserveScope() noexcept;
+
+  ReserveScope( const ReserveScope& ) = delete;
+  ReserveScope& operator=( const ReserveScope& ) = delete;
+
+  /// \return if the segments are reserved, see reserve_thread_segments().
+  explicit operator bool() const noexcept {
+    return m_reserved;
+  }
+
+  private:
+  std::size_t m_previous;
+  bool m_reserved;
+};
+
+/// Thread quotas and reservations, see reserve_thread_segments().
+struct QuotaStatistics {
+  /// Threads with a quota of their own.
+  std::size_t tracked_threads;
+  /// Segments reserved by threads, used or not.
+  std::size_t reserved_segments;
+  /// Segments claimed from the memory pool for the reservations, used or not. Exceeds the
+  /// reserved segments while segments of shrunk reservations are in flight.
+  std::size_t held_segments;
+  /// Exceptions beyond the cap of their thread, which went to the fallback chain.
+  std::uint64_t cap_rejections;
+  /// Reservations which failed because the largest size class had not enough free segments.
+  std::uint64_t reservation_rejections;
+};
+
+/** Occupancy and counters of the lane reserved for threads with a real-time scheduling policy,
+ *  see EXCEPTION_MEMORY__CXX_RT_LANE_SIZE.
+ */
+struct RealTimeLaneStatistics {
+  /// Threads detected with a real-time scheduling policy.
+  std::size_t real_time_threads;
+  /// Capacity of the lane in segments.
+  std::size_t segments;
+  /// Segments of the lane in use.
+  std::size_t used_segments;
+  /// Exceptions of real-time threads served by the lane.
+  std::uint64_t lane_allocations;
+  /// Exceptions of real-time threads served by the memory pool because the lane was exhausted.
+  std::uint64_t spilled_allocations;
+};
+
+/// Identifies a pool domain, see open_domain().
+using DomainId = std::size_t;
+/// The memory pool itself, which serves the threads bound to no other domain.
+constexpr DomainId default_domain = 0;
+/// Returned by open_domain() if there is no matching domain.
+constexpr DomainId invalid_domain = ~DomainId(0);
+/// Maximal length of a domain name including the terminating zero.
+constexpr std::size_t max_domain_name = 32;
+
+/** Opens the pool domain named \param name, e.g. by a subsystem during its initialization. The
+ *  domains are configured with EXCEPTION_MEMORY__CXX_DOMAIN_SIZES, a new name is given to the
+ *  smallest unnamed domain with at least \param segments segments. Names are cut to
+ *  max_domain_name - 1 characters and are kept until the process exits.
+ *  \return The domain named \param name, invalid_domain if all large enough domains are named or
+ *  the domain named \param name has less than \param segments segments.
+ */
+DomainId open_domain(const char *name, std::size_t segments) noexcept;
+
+/** Binds the calling thread to \param domain. The exceptions of a bound thread are allocated
+ *  from its domain only. Exceptions larger than a segment and those of an exhausted domain go
+ *  to the fallback chain and not to the memory pool. default_domain binds the thread to the
+ *  memory pool again.
+ *  \return false if \param domain is not open, the binding is left unchanged then.
+ */
+bool bind_thread_domain(DomainId domain) noexcept;
+
+/// \return The domain the calling thread is bound to.
+DomainId thread_domain() noexcept;
+
+/** Binds the calling thread to a domain for the duration of a scope. Scopes of one thread must
+ *  be nested.
+ */
+class DomainScope {
+  public:
+  /// Binds the calling thread to \param domain.
+  explicit DomainScope(DomainId domain) noexcept;
+  /// Restores the binding of the calling thread before the scope.
+  ~DomainScope() noexcept;
+
+  DomainScope( const DomainScope& ) = delete;
+  DomainScope& operator=( const DomainScope& ) = delete;
+
+  /// \return if the thread is bound to the domain, see bind_thread_domain().
+  explicit operator bool() const noexcept {
+    return m_bound;
+  }
+
+  private:
+  DomainId m_previous;
+  bool m_bound;
+};
+
+/// Occupancy and counters of a pool domain.
+struct DomainStatistics {
+  /// Name of the domain, nullptr if it is not open.
+  const char *name;
+  /// Capacity of the domain in segments.
+  std::size_t segments;
+  /// Segments currently in use.
+  std::size_t used_segments;
+  /// Exceptions allocated from the domain.
+  std::uint64_t allocations;
+  /// Exceptions which went to the fallback chain because the domain was exhausted.
+  std::uint64_t failures;
+};
+
+/// Tier of the fallback chain serving the allocations the memory pool cannot serve.
+enum class FallbackTier : std::uint8_t {
+  /// Overflow pool of EXCEPTION_MEMORY__CXX_OVERFLOW_POOL_SIZE segments of the largest size class.
+  overflow_pool,
+  /// The __cxa_allocate_exception of libstdc++, which allocates from the heap.
+  libstdcxx,
+  /// The memory resource set with set_fallback_memory_resource().
+  memory_resource,
+};
+
+/// Maximal number of tiers of the fallback chain.
+constexpr std::size_t max_fallback_tiers = 3;
+
+/** Replaces the fallback chain with the \param count tiers in \param tiers, tried in order when
+ *  the memory pool is exhausted or an exception is too large for it. Only if every tier fails
+ *  exception_memory_pool_exhausted() or exception_too_large() is called. The chain is empty by
+ *  default and can be replaced while exceptions are in flight, memory of a tier is always
+ *  returned to it. The libstdcxx tier terminates instead of failing, so it can only be the last.
+ *  \return false if a tier is unavailable, follows the libstdcxx tier or there are more than
+ *  max_fallback_tiers, the chain is left unchanged then.
+ */
+bool set_fallback_chain(const FallbackTier *tiers, std::size_t count) noexcept;
+
+/** Sets the memory resource of the FallbackTier::memory_resource tier, nullptr disables the tier.
+ *  The resource must outlive every exception allocated from it. If it throws, the tier fails.
+ */
+void set_fallback_memory_resource(std::pmr::memory_resource *resource) noexcept;
+
+/// Allocations served by the tiers of the fallback chain.
+struct FallbackStatistics {
+  /// Allocations served by the overflow pool.
+  std::uint64_t overflow_pool_hits;
+  /// Allocations served by the __cxa_allocate_exception of libstdc++.
+  std::uint64_t libstdcxx_hits;
+  /// Allocations served by the memory resource.
+  std::uint64_t memory_resource_hits;
+  /// Allocations no tier could serve.
+  std::uint64_t failures;
+};
+
+}
+
+/** Overridable function to specify behaviour if the exception memory pool and its fallback chain
+ *  are exhausted. By default this function calls std::terminate.
+ *  \param thrown_size The requested memory size.
+ *  \return A pointer to some additional memory.
+ */
+extern "C" void* exception_memory_pool_exhausted(size_t thrown_size);
+
+/** Overridable function to specify behaviour if the thrown exception is too large for the
+ *  exception memory pool and its fallback chain. By default this function calls std::terminate.
+ *  \param thrown_size The requested memory size.
+ *  \return A pointer to some additional memory.
+ */
+extern "C" void* exception_too_large(size_t thrown_size);
+
+/** Overridable function to specify behaviour if the memory pool detects an memory leak. By
+ *  default this function calls std::terminate.
+ */
+extern "C" void exception_memory_pool_leak();
+
+/** Overridable function called by the helper thread of the elastic mode after it added a slab to
+ *  the memory pool, e.g. to log the growth. By default this function does nothing.
+ *  \param slabs The number of added slabs.
+ *  \param capacity The number of segments of the memory pool including the added slabs.
+ */
+extern "C" void exception_memory_pool_grown(size_t slabs, size_t capacity);
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The number of used segments in the memory pool.
+ */
+std::size_t __get_exception_memory_pool_used_segments();
+
+/// \return The thread cache counters. All counters stay 0 if the thread caches are disabled.
+exception_memory::ThreadCacheStatistics __get_exception_memory_pool_thread_cache_statistics();
+
+/// \return The shard counters. All counters stay 0 if the pool is not sharded.
+exception_memory::ShardStatistics __get_exception_memory_pool_shard_statistics();
+
+/// \return The per CPU freelist counters. All counters stay 0 if they are disabled.
+exception_memory::PerCpuStatistics __get_exception_memory_pool_per_cpu_statistics();
+
+/// \return The NUMA placement counters. All counters stay 0 if the NUMA placement is disabled.
+exception_memory::NumaStatistics __get_exception_memory_pool_numa_statistics();
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The number of used segments in the partitions of NUMA node \param node.
+ */
+std::size_t __get_exception_memory_pool_numa_used_segments(std::size_t node);
+
+/// \return How the slabs of the memory pool are backed.
+exception_memory::BackingStatistics __get_exception_memory_pool_backing_statistics();
+
+/// \return The result of prefaulting the memory pool at startup. All values are 0 if
+/// EXCEPTION_MEMORY__CXX_PREFAULT_AND_LOCK is not defined.
+exception_memory::PrefaultResult __get_exception_memory_pool_startup_prefault();
+
+/// \return The reserved and committed bytes of the memory pool.
+exception_memory::CommitStatistics __get_exception_memory_pool_commit_statistics();
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  Writes the occupancy of up to \param count size classes to \param stats, ordered by segment
+ *  size.
+ *  \return The number of size classes.
+ */
+std::size_t __get_exception_memory_pool_size_class_statistics(
+    exception_memory::SizeClassStatistics *stats, std::size_t count);
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The occupancy of the dependent exception pool used by std::rethrow_exception. All values
+ *  are 0 if dependent exceptions are served from the exception memory pool.
+ */
+exception_memory::SizeClassStatistics __get_exception_memory_pool_dependent_statistics();
+
+/// \return The occupancy and the counters of the large exception arena.
+exception_memory::LargeExceptionStatistics __get_exception_memory_pool_large_statistics();
+
+/// \return The growth of the memory pool. All values are 0 if the elastic mode is disabled.
+exception_memory::ElasticStatistics __get_exception_memory_pool_elastic_statistics();
+
+/// \return The thread quotas and reservations. All values are 0 if the thread quotas are
+/// disabled.
+exception_memory::QuotaStatistics __get_exception_memory_pool_quota_statistics();
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The occupancy and the counters of the real-time lane. All values are 0 if the lane is
+ *  disabled.
+ */
+exception_memory::RealTimeLaneStatistics __get_exception_memory_pool_real_time_lane_statistics();
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The occupancy and the counters of \param domain. The default domain has no counters.
+ */
+exception_memory::DomainStatistics __get_exception_memory_pool_domain_statistics(
+    exception_memory::DomainId domain);
+
+/// \return The allocations served by the tiers of the fallback chain.
+exception_memory::FallbackStatistics __get_exception_memory_pool_fallback_statistics();
+
+#endif //STATIC_EXCEPTION_STATIC_EXCEPTION_HPP
@@ -12,212 +12,23 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <array>
-#include <atomic>
-#include <cstring>
-#include <cstdlib>
-#include <thread>
-#include <cxxabi.h>
-// This file is copied over from GCC to provide size information. No logic of it is used.
-#include "unwind-cxx.h"
-
-#ifdef __GNUC__
-#if __GNUC_PREREQ(5,4)
-#else
-#error Unsupported GCC version. Required version is __GNUC__.__GNUC_MINOR__.__GNUC_PATCHLEVEL__.
-#endif
-#else
-#error Unsupported compiler. Only GCC is supported.
-#endif
-
-#ifndef EXCEPTION_MEMORY__CXX_MAX_EXCEPTION_SIZE
-/** Maximal supported exception size. Note that the internal exception representation already
- * uses a small header, so the effective available size for the exception object is slightly
- * smaller. If a larger exception is thrown std::terminate is called.
- */
-#define EXCEPTION_MEMORY__CXX_MAX_EXCEPTION_SIZE 1024
-#endif
-
-#ifndef EXCEPTION_MEMORY__CXX_POOL_SIZE
-/** Maximal number of supported exceptions concurrently in flight over all threads. If the number
- *  of exceptions exceeds this limit std::terminate is called.
- */
-#define EXCEPTION_MEMORY__CXX_POOL_SIZE 64*128
-#endif
-
-#ifndef EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT
-/// Alignment of the allocated memory pool blocks.
-#define EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT 8
-#endif
-
-#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
-#include <iostream>
-#endif
+#include "exception_memory_pool.hpp"
 
 namespace exception_memory {
 namespace __cxx{
 
-/** Overridable function to specify behaviour if the exception memory pool is exhausted. By default
- *  this function calls std::terminate.
- *  \param thrown_size The requested memory size.
- *  \return A pointer to some additional memory.
- */
-inline void* exception_memory_pool_exhausted(const size_t thrown_size) {
-  std::terminate();
-  return nullptr;
-}
-
-/** Overridable function to specify behaviour if the thrown exception is too large for the
- *  exception memory pool. By default this function calls std::terminate.
- *  \param thrown_size The requested memory size.
- *  \return A pointer to some additional memory.
- */
-inline void* exception_too_large(const size_t thrown_size) {
-  std::terminate();
-  return nullptr;
-}
-
-/** Overridable function to specify behaviour if the memory pool detects an memory leak. By
- *  default this function calls std::terminate.
- */
-inline void exception_memory_pool_leak() {
-  std::terminate();
-}
-
-/// Thread safe exception memory pool.
-class ExceptionMemoryPool {
-  public:
-  static constexpr std::size_t max_exception_size = EXCEPTION_MEMORY__CXX_MAX_EXCEPTION_SIZE;
-  static constexpr std::size_t pool_size = EXCEPTION_MEMORY__CXX_POOL_SIZE;
-  static constexpr std::size_t alignment = EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT;
-
-  inline ExceptionMemoryPool() noexcept
-  {
-    (void) start_idx(); // Making sure the hasher is created on startup.
-
-    for (auto &elem : m_pool) {
-      elem.second = aligned_alloc(alignment, max_exception_size);
-      if (elem.second == nullptr) {
-#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
-        std::cerr << "Could not initalize exception memory pool. Terminating." << std::endl;
-#endif
-        std::terminate();
-      }
-    }
-  }
-
-  inline ~ExceptionMemoryPool() noexcept {
-    for (auto &elem : m_pool) {
-      free(elem.second);
-    }
-  }
-
-  ExceptionMemoryPool( const ExceptionMemoryPool& ) = delete;
-  ExceptionMemoryPool& operator=( const ExceptionMemoryPool& ) = delete;
-
-  /** Allocates \param thrown_size from the memory pool. If the exception size is to large for the
-    * pool to handle exception_too_large is called. If the memory pool is exhausted
-    * exception_memory_pool_exhausted is called.
-    * \return Pointer to the allocated memory block.
-   */
-  inline void *allocate(const size_t thrown_size) noexcept {
-    if (thrown_size > max_exception_size) {
-#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
-      std::cerr << "Exception too large." << std::endl;
-#endif
-      return exception_too_large(thrown_size);
-    }
-    auto idx = inc_idx(start_idx());
-    while (idx != start_idx()) {
-      auto& elem = m_pool[idx];
-      const auto occupied = elem.first.test_and_set();
-      if(!occupied) {
-#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
-        std::cout << "Allocate: " << elem.second << std::endl;
-#endif
-        return elem.second;
-      }
-      idx = inc_idx(idx);
-    }
-#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
-    std::cerr << "Memory pool exhausted." << std::endl;
-#endif
-    // Callback could provide additional memory.
-    return exception_memory_pool_exhausted(thrown_size);
-  }
-  /** Deallocates \param thrown_object from the pool. If the memory did not originate from this
-   *  memory pool exception_memory_pool_leak() is called.
-   */
-  inline void deallocate(void *thrown_object) noexcept {
-    auto idx = inc_idx(start_idx());
-    while (idx != start_idx()) {
-      auto& elem = m_pool[idx];
-      if (elem.second == thrown_object) {
-        elem.first.clear();
-#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
-        std::cout << "Free: " << elem.second << std::endl;
-#endif
-        return;
-      }
-      idx = inc_idx(idx);
-    }
-#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
-    std::cerr << "Freeing exception not from this pool. Memory leak present!" << std::endl;
+#ifdef EXCEPTION_MEMORY___CXX_CONSTANT_INIT
+static_assert(std::is_trivially_destructible_v<ExceptionMemoryPool>,
+    "A constant-initialised memory pool must stay valid until the process exits.");
+/// Constant-initialised into .bss: no constructor runs, so exceptions thrown by any static
+/// initializer are served by the pool, and no destructor runs before the process exits.
+__constinit static ExceptionMemoryPool cxx_exception_memory_pool;
+#else
+/// Constructed before the other static objects of this library and never destroyed.
+__attribute__((init_priority(101))) static NeverDestroyed<ExceptionMemoryPool>
+    cxx_exception_memory_pool_storage;
+static ExceptionMemoryPool &cxx_exception_memory_pool = cxx_exception_memory_pool_storage.value;
 #endif
-    exception_memory_pool_leak();
-  }
-
-  /** WARNING: This function is not thread safe! Only use it for testing!
-   *  \return The number of used segments in the memory pool.
-   */
-  inline std::size_t used_segments() noexcept {
-    std::size_t counter = std::size_t();
-    for(auto& elem : m_pool)
-    {
-      auto orig = elem.first.test_and_set();
-      if(orig) {
-        ++counter;
-      }
-      else {
-        elem.first.clear();
-      }
-    }
-    return counter;
-  }
-
-  /// \returns if \param vptr was allocated from this memory pool.
-  inline bool is_allocated_by_this_pool(void *vptr) const noexcept {
-    void *ptr = (char *) vptr - sizeof (__cxxabiv1::__cxa_refcounted_exception);
-    for (const auto& elem : m_pool) {
-      if (ptr == elem.second) {
-        return true;
-      }
-    }
-    return false;
-  }
-  private:
-  std::array <std::pair<std::atomic_flag, void *>, pool_size> m_pool;
-
-  /// \return The thread specific start of where to look for a free memory segment.
-  std::size_t start_idx() const noexcept  {
-    static const auto hasher = std::hash<std::thread::id>();
-    static const thread_local std::size_t t =
-        hasher(std::this_thread::get_id()) % pool_size; // const (threadsafe) nothrow operation
-    return t;
-  }
-
-  /// \return \param idx increased by 1 modulo pool_size.
-  std::size_t inc_idx(const std::size_t idx) const noexcept {
-    if (idx + 1 == pool_size) {
-      return 0;
-    }
-    else {
-      return idx + 1;
-    }
-  }
-};
-
-static ExceptionMemoryPool cxx_exception_memory_pool;
 
 /** Helper function which gets memory from the exception memory pool and transforms it into a
  *  format usable by the compiler.
@@ -226,10 +37,10 @@ static ExceptionMemoryPool cxx_exception_memory_pool;
  */
 inline void * cxa_allocate_exception(size_t thrown_size) noexcept
 {
-  thrown_size += sizeof (__cxxabiv1::__cxa_refcounted_exception);
-  auto ret = cxx_exception_memory_pool.allocate(thrown_size);
-  memset (ret, 0, sizeof (__cxxabiv1::__cxa_refcounted_exception));
-  return (void *)((char *)ret + sizeof (__cxxabiv1::__cxa_refcounted_exception));
+  thrown_size += object_offset;
+  auto ret = (char *) cxx_exception_memory_pool.allocate(thrown_size);
+  memset (ret + object_offset - header_size, 0, header_size);
+  return (void *)(ret + object_offset);
 }
 
 /** Helper function which frees memory from the exception memory pool.
@@ -237,7 +48,7 @@ inline void * cxa_allocate_exception(size_t thrown_size) noexcept
  */
 inline void cxa_free_exception(void *vptr) noexcept
 {
-  char *ptr = (char *) vptr - sizeof (__cxxabiv1::__cxa_refcounted_exception);
+  char *ptr = (char *) vptr - object_offset;
   cxx_exception_memory_pool.deallocate(ptr);
 }
 
@@ -247,7 +58,7 @@ inline void cxa_free_exception(void *vptr) noexcept
  */
 inline void* cxa_allocate_dependent_exception() noexcept
 {
-  void * ret = cxx_exception_memory_pool.allocate(sizeof (__cxxabiv1::__cxa_dependent_exception));
+  void * ret = cxx_exception_memory_pool.allocate_dependent();
   memset (ret, 0, sizeof (__cxxabiv1::__cxa_dependent_exception));
   return ret;
 }
@@ -258,7 +69,7 @@ inline void* cxa_allocate_dependent_exception() noexcept
  */
 inline void cxa_free_dependent_exception (void *vptr) noexcept
 {
-  cxx_exception_memory_pool.deallocate(vptr);
+  cxx_exception_memory_pool.deallocate_dependent(vptr);
 }
 
 }
@@ -271,6 +82,208 @@ std::size_t __get_exception_memory_pool_used_segments() {
   return exception_memory::__cxx::cxx_exception_memory_pool.used_segments();
 }
 
+/// \return The thread cache counters. All counters stay 0 if the thread caches are disabled.
+exception_memory::ThreadCacheStatistics __get_exception_memory_pool_thread_cache_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::ThreadCacheStatistics>();
+}
+
+/// \return The shard counters. All counters stay 0 if the pool is not sharded.
+exception_memory::ShardStatistics __get_exception_memory_pool_shard_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::ShardStatistics>();
+}
+
+/// \return The per CPU freelist counters. All counters stay 0 if they are disabled.
+exception_memory::PerCpuStatistics __get_exception_memory_pool_per_cpu_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::PerCpuStatistics>();
+}
+
+/// \return The NUMA placement counters. All counters stay 0 if the NUMA placement is disabled.
+exception_memory::NumaStatistics __get_exception_memory_pool_numa_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::NumaStatistics>();
+}
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The number of used segments in the partitions of NUMA node \param node.
+ */
+std::size_t __get_exception_memory_pool_numa_used_segments(const std::size_t node) {
+  exception_memory::NumaNodeOccupancy occupancy{node, 0};
+  exception_memory::__cxx::cxx_exception_memory_pool.collect(occupancy);
+  return occupancy.used_segments;
+}
+
+void exception_memory::set_numa_topology(const std::uint16_t *cpu_to_node,
+                                         const std::size_t cpus) noexcept {
+  exception_memory::__cxx::numa_topology().set(cpu_to_node, cpus);
+}
+
+/// \return How the slabs of the memory pool are backed.
+exception_memory::BackingStatistics __get_exception_memory_pool_backing_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::BackingStatistics>();
+}
+
+exception_memory::PrefaultResult exception_memory::prefault_and_lock() noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.prefault_and_lock();
+}
+
+std::size_t exception_memory::trim() noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.trim();
+}
+
+bool exception_memory::configure_pool(const exception_memory::PoolGeometry &geometry) noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.configure(geometry);
+}
+
+exception_memory::PoolGeometry exception_memory::pool_geometry() noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.geometry();
+}
+
+void exception_memory::warm_up_thread() noexcept {
+  exception_memory::__cxx::cxx_exception_memory_pool.warm_up_thread();
+}
+
+/// \return The result of prefaulting the memory pool at startup. All values are 0 if
+/// EXCEPTION_MEMORY__CXX_PREFAULT_AND_LOCK is not defined.
+exception_memory::PrefaultResult __get_exception_memory_pool_startup_prefault() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.startup_prefault();
+}
+
+/// \return The reserved and committed bytes of the memory pool.
+exception_memory::CommitStatistics __get_exception_memory_pool_commit_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::CommitStatistics>();
+}
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  Writes the occupancy of up to \param count size classes to \param stats.
+ *  \return The number of size classes.
+ */
+std::size_t __get_exception_memory_pool_size_class_statistics(
+    exception_memory::SizeClassStatistics *stats, const std::size_t count) {
+  return exception_memory::__cxx::cxx_exception_memory_pool.size_class_statistics(stats, count);
+}
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The occupancy of the dependent exception pool.
+ */
+exception_memory::SizeClassStatistics __get_exception_memory_pool_dependent_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.dependent_statistics();
+}
+
+bool exception_memory::set_fallback_chain(const exception_memory::FallbackTier *tiers,
+                                          const std::size_t count) noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.fallback().set_tiers(tiers, count);
+}
+
+void exception_memory::set_fallback_memory_resource(
+    std::pmr::memory_resource *const resource) noexcept {
+  exception_memory::__cxx::cxx_exception_memory_pool.fallback().set_memory_resource(resource);
+}
+
+/// \return The allocations served by the tiers of the fallback chain.
+exception_memory::FallbackStatistics __get_exception_memory_pool_fallback_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::FallbackStatistics>();
+}
+
+/// \return The occupancy and the counters of the large exception arena.
+exception_memory::LargeExceptionStatistics __get_exception_memory_pool_large_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::LargeExceptionStatistics>();
+}
+
+bool exception_memory::reserve_thread_segments(const std::size_t segments) noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.reserve_thread_segments(segments);
+}
+
+std::size_t exception_memory::thread_reserved_segments() noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.thread_reserved_segments();
+}
+
+exception_memory::ReserveScope::ReserveScope(const std::size_t segments) noexcept
+    : m_previous(thread_reserved_segments()),
+      m_reserved(reserve_thread_segments(m_previous + segments)) {}
+
+exception_memory::ReserveScope::~ReserveScope() noexcept {
+  if (m_reserved) {
+    reserve_thread_segments(m_previous);
+  }
+}
+
+/// \return The thread quotas and reservations. All values are 0 if the thread quotas are
+/// disabled.
+exception_memory::QuotaStatistics __get_exception_memory_pool_quota_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::QuotaStatistics>();
+}
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The occupancy and the counters of the real-time lane.
+ */
+exception_memory::RealTimeLaneStatistics __get_exception_memory_pool_real_time_lane_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::RealTimeLaneStatistics>();
+}
+
+exception_memory::DomainId exception_memory::open_domain(const char *name,
+                                                        const std::size_t segments) noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.open_domain(name, segments);
+}
+
+bool exception_memory::bind_thread_domain(const exception_memory::DomainId domain) noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.bind_thread_domain(domain);
+}
+
+exception_memory::DomainId exception_memory::thread_domain() noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.thread_domain();
+}
+
+exception_memory::DomainScope::DomainScope(const exception_memory::DomainId domain) noexcept
+    : m_previous(thread_domain()), m_bound(bind_thread_domain(domain)) {}
+
+exception_memory::DomainScope::~DomainScope() noexcept {
+  if (m_bound) {
+    bind_thread_domain(m_previous);
+  }
+}
+
+/** WARNING: This function is not thread safe! Only use it for testing!
+ *  \return The occupancy and the counters of \param domain.
+ */
+exception_memory::DomainStatistics __get_exception_memory_pool_domain_statistics(
+    const exception_memory::DomainId domain) {
+  return exception_memory::__cxx::cxx_exception_memory_pool.domain_statistics(domain);
+}
+
+bool exception_memory::start_elastic_growth() noexcept {
+  return exception_memory::__cxx::cxx_exception_memory_pool.start_elastic_growth();
+}
+
+/// \return The growth of the memory pool. All values are 0 if the elastic mode is disabled.
+exception_memory::ElasticStatistics __get_exception_memory_pool_elastic_statistics() {
+  return exception_memory::__cxx::cxx_exception_memory_pool.statistics<
+      exception_memory::ElasticStatistics>();
+}
+
+// Default handlers, weak so an application can override them.
+extern "C" __attribute__((weak)) void* exception_memory_pool_exhausted(size_t) {
+  std::terminate();
+}
+
+extern "C" __attribute__((weak)) void* exception_too_large(size_t) {
+  std::terminate();
+}
+
+extern "C" __attribute__((weak)) void exception_memory_pool_leak() {
+  std::terminate();
+}
+
+extern "C" __attribute__((weak)) void exception_memory_pool_grown(size_t, size_t) {}
+
 // Override the compiler functions
 extern "C" void * __cxa_allocate_exception(size_t thrown_size) _GLIBCXX_NOTHROW
 {
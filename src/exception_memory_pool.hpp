@@ -0,0 +1,4810 @@
+// Copyright 2018 Apex.AI, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STATIC_EXCEPTION_EXCEPTION_MEMORY_POOL_HPP
+#define STATIC_EXCEPTION_EXCEPTION_MEMORY_POOL_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <iterator>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define EXCEPTION_MEMORY__CXX_HAVE_RSEQ
+#endif
+#include "static_exception.hpp"
+// This file is copied over from GCC to provide size information. No logic of it is used.
+#include "unwind-cxx.h"
+
+#ifdef __GNUC__
+#if __GNUC_PREREQ(5,4)
+#else
+#error Unsupported GCC version. Required version is __GNUC__.__GNUC_MINOR__.__GNUC_PATCHLEVEL__.
+#endif
+#else
+#error Unsupported compiler. Only GCC is supported.
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_MAX_EXCEPTION_SIZE
+/** Maximal supported exception size. Note that the internal exception representation already
+ * uses a small header, so the effective available size for the exception object is slightly
+ * smaller. If a larger exception is thrown std::terminate is called.
+ */
+#define EXCEPTION_MEMORY__CXX_MAX_EXCEPTION_SIZE 1024
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_POOL_SIZE
+/** Maximal number of supported exceptions concurrently in flight over all threads. If the number
+ *  of exceptions exceeds this limit std::terminate is called.
+ */
+#define EXCEPTION_MEMORY__CXX_POOL_SIZE 64*128
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_SIZE_CLASS_SIZES
+/** Comma separated, ascending segment sizes of the size classes. The sizes include the internal
+ *  exception header. By default there is a single size class of
+ *  EXCEPTION_MEMORY__CXX_MAX_EXCEPTION_SIZE bytes. The largest size class determines the maximal
+ *  supported exception size.
+ */
+#define EXCEPTION_MEMORY__CXX_SIZE_CLASS_SIZES EXCEPTION_MEMORY__CXX_MAX_EXCEPTION_SIZE
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_SIZE_CLASS_COUNTS
+/** Comma separated number of segments of every size class. By default the single size class has
+ *  EXCEPTION_MEMORY__CXX_POOL_SIZE segments.
+ */
+#define EXCEPTION_MEMORY__CXX_SIZE_CLASS_COUNTS EXCEPTION_MEMORY__CXX_POOL_SIZE
+#endif
+
+// Define EXCEPTION_MEMORY__CXX_PER_CPU_FREELISTS to keep a freelist of free segments per CPU in
+// front of the shared pool.
+
+#ifndef EXCEPTION_MEMORY__CXX_MAX_CPUS
+/// Number of per CPU freelists. CPUs with a higher index share freelists.
+#define EXCEPTION_MEMORY__CXX_MAX_CPUS 256
+#endif
+
+#if defined(EXCEPTION_MEMORY__CXX_PER_CPU_FREELISTS) && EXCEPTION_MEMORY__CXX_THREAD_CACHE_SIZE > 0
+#error Per CPU freelists and thread caches are mutually exclusive.
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_NUMA_NODES
+/** Number of NUMA node partitions every pool is split into. The memory of partition n is bound
+ *  to node n and threads prefer the partition of the node they run on. 0 disables the NUMA
+ *  placement.
+ */
+#define EXCEPTION_MEMORY__CXX_NUMA_NODES 0
+#endif
+
+// Define EXCEPTION_MEMORY__CXX_USE_HUGE_PAGES to back the pools with 2 MiB pages. Reserved huge
+// pages (MAP_HUGETLB) are preferred, otherwise transparent huge pages are requested.
+
+#ifndef EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE
+/** Granularity in bytes in which the pools are committed. If greater than 0 only the address
+ *  range of the pools is reserved at startup, and a chunk is committed and prefaulted when a
+ *  segment in it is allocated for the first time. 0 commits the pools at startup.
+ */
+#define EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE 0
+#endif
+
+#if defined(EXCEPTION_MEMORY__CXX_USE_HUGE_PAGES) && EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE > 0
+#error Huge pages and lazy commit are mutually exclusive.
+#endif
+
+// Define EXCEPTION_MEMORY__CXX_PREFAULT_AND_LOCK to fault in every page of the pools and lock them
+// in RAM when the memory pool is initialized.
+
+#ifndef EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE
+/** Maximal number of dependent exceptions (created by std::rethrow_exception) concurrently in
+ *  flight over all threads. They are served from a separate pool whose segments have exactly
+ *  their size. If set to 0 they are served from the exception memory pool instead.
+ */
+#define EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE 64*128
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE
+/** Size in bytes of the arena serving the exceptions too large for the largest size class, a
+ *  power of two. The arena is managed by a buddy allocator, so a few rare large exceptions do not
+ *  force a large segment size on every segment. 0 disables the arena.
+ */
+#define EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE 0
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_LARGE_BLOCK_SIZE
+/// Smallest block of the large exception arena, a power of two.
+#define EXCEPTION_MEMORY__CXX_LARGE_BLOCK_SIZE 4096
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_OVERFLOW_POOL_SIZE
+/** Number of segments of the overflow pool, a fallback tier with segments of the largest size
+ *  class which exception_memory::set_fallback_chain() can put behind the memory pool. 0 disables
+ *  the overflow pool.
+ */
+#define EXCEPTION_MEMORY__CXX_OVERFLOW_POOL_SIZE 0
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_ELASTIC_SLABS
+/** Maximal number of slabs the memory pool grows by in elastic mode. Once the share of used
+ *  segments crosses EXCEPTION_MEMORY__CXX_ELASTIC_WATERMARK, the helper thread started by
+ *  exception_memory::start_elastic_growth() maps another prefaulted slab with segments of the
+ *  largest size class. 0 disables the elastic mode.
+ */
+#define EXCEPTION_MEMORY__CXX_ELASTIC_SLABS 0
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_ELASTIC_SLAB_SIZE
+/// Number of segments of every slab added in elastic mode.
+#define EXCEPTION_MEMORY__CXX_ELASTIC_SLAB_SIZE 1024
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_ELASTIC_WATERMARK
+/// Percentage of used segments above which the memory pool grows in elastic mode.
+#define EXCEPTION_MEMORY__CXX_ELASTIC_WATERMARK 75
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_RT_LANE_SIZE
+/** Number of segments of the largest size class reserved for threads with a real-time scheduling
+ *  policy (SCHED_FIFO, SCHED_RR or SCHED_DEADLINE). Their exceptions are served by the lane
+ *  first and by the memory pool once it is exhausted, other threads never use the lane. 0
+ *  disables the lane.
+ */
+#define EXCEPTION_MEMORY__CXX_RT_LANE_SIZE 0
+#endif
+
+// Define EXCEPTION_MEMORY__CXX_DOMAIN_SIZES as a comma separated list of segment counts to add
+// pool domains with segments of the largest size class. exception_memory::open_domain() names
+// them at runtime, threads bound to a domain only allocate from it.
+
+#ifndef EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT
+/// Alignment of the allocated memory pool blocks.
+#define EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT 8
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_OBJECT_ALIGNMENT
+/** Alignment of the thrown exception objects, at most a cache line. The exception header is
+ *  placed right before the object, as the ABI requires.
+ */
+#define EXCEPTION_MEMORY__CXX_OBJECT_ALIGNMENT __BIGGEST_ALIGNMENT__
+#endif
+
+// Define EXCEPTION_MEMORY__CXX_COLOUR_SLOTS to place neighbouring segments an odd number of cache
+// lines apart, so their exception headers map to different cache sets.
+
+#ifndef EXCEPTION_MEMORY__CXX_CACHE_LINE_SIZE
+/// Cache line size the segments are coloured with.
+#define EXCEPTION_MEMORY__CXX_CACHE_LINE_SIZE 64
+#endif
+
+// Define EXCEPTION_MEMORY__CXX_USE_FREELIST to hand out segments from a lock-free freelist
+// instead of probing for a free segment.
+
+#ifndef EXCEPTION_MEMORY__CXX_SHARDS
+/** Number of shards the occupancy bitmap is split into. Threads are assigned to shards
+ *  round-robin and only take segments from other shards if their own one is exhausted. 0 lets
+ *  every thread probe the whole bitmap starting at a position derived from its id.
+ */
+#define EXCEPTION_MEMORY__CXX_SHARDS 0
+#endif
+
+#if defined(EXCEPTION_MEMORY__CXX_USE_FREELIST) && EXCEPTION_MEMORY__CXX_SHARDS > 0
+#error Sharding is only supported for the probing segment allocator.
+#endif
+
+// Define EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY to choose the segment size, the number of segments
+// and the alignment of the pool at process start. The compile time values are the defaults, which
+// the environment variables EXCEPTION_MEMORY_SEGMENT_SIZE, EXCEPTION_MEMORY_SEGMENTS and
+// EXCEPTION_MEMORY_ALIGNMENT and exception_memory::configure_pool() override.
+
+#ifndef EXCEPTION_MEMORY__CXX_THREAD_CACHE_SIZE
+/** Number of free segments every thread keeps for its own use in front of the shared pool. 0
+ *  disables the thread caches.
+ */
+#define EXCEPTION_MEMORY__CXX_THREAD_CACHE_SIZE 0
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_MAX_THREAD_CACHES
+/// Maximal number of threads owning a thread cache at the same time. Further threads use the
+/// shared pool directly.
+#define EXCEPTION_MEMORY__CXX_MAX_THREAD_CACHES 256
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_THREAD_QUOTA
+/** Maximal number of exceptions a thread can have in flight in the memory pool, unless it
+ *  reserved more with exception_memory::reserve_thread_segments(). Further exceptions of the
+ *  thread go to the fallback chain. Setting it enables the thread quotas and reservations, 0
+ *  disables them. At most 2^21 - 1.
+ */
+#define EXCEPTION_MEMORY__CXX_THREAD_QUOTA 0
+#endif
+
+#ifndef EXCEPTION_MEMORY__CXX_MAX_QUOTA_THREADS
+/// Maximal number of threads with a quota of their own at the same time. Further threads share
+/// a single quota without cap and cannot reserve segments.
+#define EXCEPTION_MEMORY__CXX_MAX_QUOTA_THREADS 256
+#endif
+
+#if defined(EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY) && (defined(EXCEPTION_MEMORY__CXX_USE_FREELIST) || \
+    EXCEPTION_MEMORY__CXX_SHARDS > 0 || EXCEPTION_MEMORY__CXX_THREAD_CACHE_SIZE > 0 || \
+    defined(EXCEPTION_MEMORY__CXX_PER_CPU_FREELISTS) || EXCEPTION_MEMORY__CXX_NUMA_NODES > 0)
+#error The runtime geometry is only supported for the probing segment allocator.
+#endif
+
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+#include <iostream>
+#endif
+
+namespace exception_memory {
+namespace __cxx{
+
+namespace bitmap {
+
+static constexpr std::size_t bits = 64;
+
+/** Claims the lowest free bit of \param word.
+ *  \return The index of the claimed bit or bits if the word is full.
+ */
+inline std::size_t claim(std::atomic<std::uint64_t> &word) noexcept {
+  auto used = word.load(std::memory_order_relaxed);
+  while (~used != 0) {
+    const auto bit = std::uint64_t(1) << __builtin_ctzll(~used);
+    if (word.compare_exchange_weak(used, used | bit,
+        std::memory_order_acquire, std::memory_order_relaxed)) {
+      return __builtin_ctzll(bit);
+    }
+  }
+  return bits;
+}
+
+/** Claims up to \param count of the lowest free bits of \param word with a single exchange.
+ *  \return A mask of the claimed bits.
+ */
+inline std::uint64_t claim(std::atomic<std::uint64_t> &word, const std::size_t count) noexcept {
+  auto used = word.load(std::memory_order_relaxed);
+  while (~used != 0) {
+    auto free = ~used;
+    auto claimed = std::uint64_t();
+    for (std::size_t n = 0; free != 0 && n < count; ++n) {
+      claimed |= free & (~free + 1);
+      free &= free - 1;
+    }
+    if (word.compare_exchange_weak(used, used | claimed,
+        std::memory_order_acquire, std::memory_order_relaxed)) {
+      return claimed;
+    }
+  }
+  return std::uint64_t();
+}
+
+/// Claims the bit \param bit of \param word if it is free. \return if the bit was claimed.
+inline bool claim_bit(std::atomic<std::uint64_t> &word, const std::size_t bit) noexcept {
+  const auto mask = std::uint64_t(1) << bit;
+  return (word.load(std::memory_order_relaxed) & mask) == 0 &&
+      (word.fetch_or(mask, std::memory_order_acquire) & mask) == 0;
+}
+
+/// \return if the bit \param bit of \param word is free.
+inline bool is_free(const std::atomic<std::uint64_t> &word, const std::size_t bit) noexcept {
+  return (word.load(std::memory_order_relaxed) >> bit & 1) == 0;
+}
+
+/// Frees the bit \param bit of \param word.
+inline void release(std::atomic<std::uint64_t> &word, const std::size_t bit) noexcept {
+  word.fetch_and(~(std::uint64_t(1) << bit), std::memory_order_release);
+}
+
+/** \return A word in which the bits from \param first on are set, those bits do not represent
+ *  a segment and stay occupied forever.
+ */
+constexpr std::uint64_t padding(const std::size_t first) noexcept {
+  return first >= bits ? std::uint64_t() : ~std::uint64_t() << first;
+}
+
+/// \return The word after \param idx in a bitmap of Words words, wrapping around at the end.
+template <std::size_t Words>
+constexpr std::size_t next_word(const std::size_t idx) noexcept {
+  if constexpr ((Words & (Words - 1)) == 0) {
+    return (idx + 1) & (Words - 1);
+  }
+  else {
+    return idx + 1 == Words ? 0 : idx + 1;
+  }
+}
+
+}
+
+/// Counter which compiles to nothing, used if the statistics are disabled.
+struct NoCounter {
+  constexpr NoCounter(std::uint64_t = 0) noexcept {}
+  void fetch_add(std::uint64_t, std::memory_order) noexcept {}
+  void store(std::uint64_t, std::memory_order) noexcept {}
+  std::uint64_t load(std::memory_order) const noexcept {
+    return 0;
+  }
+};
+
+/// Counter of the statistics, a NoCounter if \tparam Enabled is false.
+template <bool Enabled>
+using Counter = std::conditional_t<Enabled, std::atomic<std::uint64_t>, NoCounter>;
+
+/// Start index policy of the probing segment allocator: every thread starts at a word derived
+/// from its id, which spreads concurrent threads over the bitmap.
+struct ThreadStartIndex {
+  /// \return The word the calling thread starts probing at in a bitmap of Words words.
+  template <std::size_t Words>
+  static std::size_t word() noexcept {
+    static const auto hasher = std::hash<std::thread::id>();
+    static const thread_local std::size_t t = (Words & (Words - 1)) == 0 ?
+        hasher(std::this_thread::get_id()) & (Words - 1) :
+        hasher(std::this_thread::get_id()) % Words; // const (threadsafe) nothrow operation
+    return t;
+  }
+};
+
+/// Start index policy of the probing segment allocator: every thread starts at the first word,
+/// which keeps the used segments at the start of the slab.
+struct FirstStartIndex {
+  template <std::size_t Words>
+  static constexpr std::size_t word() noexcept {
+    return 0;
+  }
+};
+
+/** Hands out segment indices by probing an occupancy bitmap word by word, starting at a word
+ *  chosen by the start index policy. A free segment is found with a single load and a count of
+ *  trailing zeros per 64 segments and claimed with an exchange. The bitmap starts out zeroed, so
+ *  the allocator is constant-initialised; padding bits are claimed for good when first found.
+ *  \tparam Size Number of managed segments.
+ *  \tparam StartIndex Policy choosing the word a thread starts probing at.
+ */
+template <std::size_t Size, typename StartIndex = ThreadStartIndex>
+class ProbingSegmentAllocator {
+  static constexpr std::size_t words = (Size + bitmap::bits - 1) / bitmap::bits;
+
+  public:
+  constexpr ProbingSegmentAllocator() noexcept = default;
+
+  /// \return The index of a free segment which is now marked as used or Size if none is free.
+  inline std::size_t acquire() noexcept {
+    auto word_idx = start_word();
+    for (std::size_t i = 0; i < words; ++i) {
+      const auto bit = bitmap::claim(m_used[word_idx]);
+      const auto idx = word_idx * bitmap::bits + bit;
+      // A claimed padding bit means the word is full.
+      if (bit != bitmap::bits && idx < Size) {
+        return idx;
+      }
+      word_idx = bitmap::next_word<words>(word_idx);
+    }
+    return Size;
+  }
+
+  /** Acquires up to \param count free segments and stores their indices in \param indices.
+   *  Segments sharing a bitmap word are claimed with a single exchange.
+   *  \return The number of acquired segments.
+   */
+  inline std::size_t acquire(std::size_t *indices, const std::size_t count) noexcept {
+    std::size_t acquired = std::size_t();
+    auto word_idx = start_word();
+    for (std::size_t i = 0; i < words && acquired < count; ++i) {
+      for (auto claimed = bitmap::claim(m_used[word_idx], count - acquired) &
+               ~padding(word_idx); claimed != 0; claimed &= claimed - 1) {
+        indices[acquired++] = word_idx * bitmap::bits + __builtin_ctzll(claimed);
+      }
+      word_idx = bitmap::next_word<words>(word_idx);
+    }
+    return acquired;
+  }
+
+  /// Marks the segment \param idx as free again.
+  inline void release(const std::size_t idx) noexcept {
+    bitmap::release(m_used[idx / bitmap::bits], idx % bitmap::bits);
+  }
+
+  /// Marks the \param count segments in \param indices as free again.
+  inline void release(const std::size_t *indices, const std::size_t count) noexcept {
+    for (std::size_t i = 0; i < count; ++i) {
+      release(indices[i]);
+    }
+  }
+
+  /// Marks the segment \param idx as used if it is free. \return if it was free.
+  inline bool try_acquire(const std::size_t idx) noexcept {
+    return bitmap::claim_bit(m_used[idx / bitmap::bits], idx % bitmap::bits);
+  }
+
+  /// Marks the segment \param idx acquired by try_acquire() as free again.
+  inline void release_claimed(const std::size_t idx) noexcept {
+    release(idx);
+  }
+
+  /// \return if the segment \param idx is free.
+  inline bool is_free(const std::size_t idx) const noexcept {
+    return bitmap::is_free(m_used[idx / bitmap::bits], idx % bitmap::bits);
+  }
+
+  /// \return The number of used segments. Exact if no other thread modifies the pool.
+  inline std::size_t used() const noexcept {
+    std::size_t counter = std::size_t();
+    for (std::size_t i = 0; i < words; ++i) {
+      counter += __builtin_popcountll(
+          m_used[i].load(std::memory_order_relaxed) & ~padding(i));
+    }
+    return counter;
+  }
+
+  /// This allocator has no counters.
+  template <typename Statistics>
+  inline void collect(Statistics &) const noexcept {}
+
+  private:
+  std::array<std::atomic<std::uint64_t>, words> m_used{};
+
+  /// \return The word of where to look for a free memory segment.
+  static std::size_t start_word() noexcept {
+    return StartIndex::template word<words>();
+  }
+
+  /// \return The bits of the word \param word_idx which do not represent a segment.
+  static constexpr std::uint64_t padding(const std::size_t word_idx) noexcept {
+    return bitmap::padding(Size - word_idx * bitmap::bits);
+  }
+};
+
+#ifdef EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY
+/** Probing segment allocator whose number of segments is chosen at runtime. The bitmap is
+ *  allocated on construction and the start word is derived from the thread id by a multiplication
+ *  instead of a modulo.
+ */
+class RuntimeProbingSegmentAllocator {
+  public:
+  /// Manages \param size segments.
+  inline explicit RuntimeProbingSegmentAllocator(const std::size_t size) noexcept
+      : m_size(size), m_words((size + bitmap::bits - 1) / bitmap::bits) {
+    m_used = static_cast<std::atomic<std::uint64_t> *>(
+        aligned_alloc(64, (m_words * sizeof (std::atomic<std::uint64_t>) + 63) / 64 * 64));
+    if (m_used == nullptr) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cerr << "Could not initalize exception memory pool. Terminating." << std::endl;
+#endif
+      std::terminate();
+    }
+    for (std::size_t i = 0; i < m_words; ++i) {
+      new (&m_used[i]) std::atomic<std::uint64_t>(bitmap::padding(size - i * bitmap::bits));
+    }
+  }
+
+  inline ~RuntimeProbingSegmentAllocator() noexcept {
+    free(m_used);
+  }
+
+  RuntimeProbingSegmentAllocator( const RuntimeProbingSegmentAllocator& ) = delete;
+  RuntimeProbingSegmentAllocator& operator=( const RuntimeProbingSegmentAllocator& ) = delete;
+
+  /// \return The index of a free segment which is now marked as used or the number of segments
+  /// if none is free.
+  inline std::size_t acquire() noexcept {
+    auto word_idx = start_word();
+    for (std::size_t i = 0; i < m_words; ++i) {
+      const auto bit = bitmap::claim(m_used[word_idx]);
+      if (bit != bitmap::bits) {
+        return word_idx * bitmap::bits + bit;
+      }
+      word_idx = word_idx + 1 == m_words ? 0 : word_idx + 1;
+    }
+    return m_size;
+  }
+
+  /// Marks the segment \param idx as free again.
+  inline void release(const std::size_t idx) noexcept {
+    bitmap::release(m_used[idx / bitmap::bits], idx % bitmap::bits);
+  }
+
+  /// Marks the segment \param idx as used if it is free. \return if it was free.
+  inline bool try_acquire(const std::size_t idx) noexcept {
+    return bitmap::claim_bit(m_used[idx / bitmap::bits], idx % bitmap::bits);
+  }
+
+  /// Marks the segment \param idx acquired by try_acquire() as free again.
+  inline void release_claimed(const std::size_t idx) noexcept {
+    release(idx);
+  }
+
+  /// \return if the segment \param idx is free.
+  inline bool is_free(const std::size_t idx) const noexcept {
+    return bitmap::is_free(m_used[idx / bitmap::bits], idx % bitmap::bits);
+  }
+
+  /// \return The number of used segments. Exact if no other thread modifies the pool.
+  inline std::size_t used() const noexcept {
+    std::size_t counter = std::size_t();
+    for (std::size_t i = 0; i < m_words; ++i) {
+      counter += __builtin_popcountll(m_used[i].load(std::memory_order_relaxed));
+    }
+    return counter - (m_words * bitmap::bits - m_size);
+  }
+
+  /// This allocator has no counters.
+  template <typename Statistics>
+  inline void collect(Statistics &) const noexcept {}
+
+  private:
+  const std::size_t m_size;
+  const std::size_t m_words;
+  std::atomic<std::uint64_t> *m_used = nullptr;
+
+  /// \return The thread specific word of where to look for a free memory segment.
+  std::size_t start_word() const noexcept {
+    static const auto hasher = std::hash<std::thread::id>();
+    static const thread_local std::uint32_t t =
+        static_cast<std::uint32_t>(hasher(std::this_thread::get_id()));
+    // Maps the hash to [0, m_words) without a division.
+    return static_cast<std::size_t>((std::uint64_t(t) * m_words) >> 32);
+  }
+};
+
+#endif
+
+/** Hands out segment indices from an occupancy bitmap split into shards, each on its own cache
+ *  lines. Threads are assigned to shards round-robin in the order they first allocate, so
+ *  neighbouring threads never share a shard. A thread only steals from other shards if its own
+ *  shard is exhausted. The shard sizes differ by at most one segment.
+ *  \tparam Size Number of managed segments.
+ *  \tparam Shards Number of shards.
+ *  \tparam EnableStatistics Whether the local hits and steals are counted.
+ */
+template <std::size_t Size, std::size_t Shards, bool EnableStatistics = true>
+class ShardedSegmentAllocator {
+  static_assert(Shards > 0 && Shards <= Size, "Every shard must be able to hold a segment.");
+  /// The first larger_shards shards hold one segment more than the others.
+  static constexpr std::size_t larger_shards = Size % Shards;
+  static constexpr std::size_t shard_size = Size / Shards + (larger_shards > 0 ? 1 : 0);
+  static constexpr std::size_t shard_words = (shard_size + bitmap::bits - 1) / bitmap::bits;
+
+  public:
+  inline ShardedSegmentAllocator() noexcept {
+    for (std::size_t shard_idx = 0; shard_idx < Shards; ++shard_idx) {
+      const auto segments = Size / Shards + (shard_idx < larger_shards ? 1 : 0);
+      auto &shard = m_shards[shard_idx];
+      for (std::size_t i = 0; i < shard_words; ++i) {
+        const auto first = i * bitmap::bits;
+        shard.words[i].store(bitmap::padding(segments > first ? segments - first : 0),
+                             std::memory_order_relaxed);
+      }
+      m_padding += shard_words * bitmap::bits - segments;
+    }
+  }
+
+  /// \return The index of a free segment which is now marked as used or Size if none is free.
+  inline std::size_t acquire() noexcept {
+    const auto own_idx = thread_shard();
+    auto &own = m_shards[own_idx];
+    for (std::size_t i = 0; i < shard_words; ++i) {
+      const auto bit = bitmap::claim(own.words[i]);
+      if (bit != bitmap::bits) {
+        own.local_hits.fetch_add(1, std::memory_order_relaxed);
+        return shard_begin(own_idx) + i * bitmap::bits + bit;
+      }
+    }
+    std::size_t idx;
+    return acquire(&idx, 1) == 1 ? idx : Size;
+  }
+
+  /** Acquires up to \param count free segments and stores their indices in \param indices.
+   *  \return The number of acquired segments.
+   */
+  inline std::size_t acquire(std::size_t *indices, const std::size_t count) noexcept {
+    const auto own_idx = thread_shard();
+    auto &own = m_shards[own_idx];
+    auto acquired = acquire_from(own_idx, indices, count);
+    if (acquired > 0) {
+      own.local_hits.fetch_add(acquired, std::memory_order_relaxed);
+    }
+    if (acquired == count) {
+      return acquired;
+    }
+    const auto local = acquired;
+    auto shard_idx = own_idx;
+    for (std::size_t i = 1; i < Shards && acquired < count; ++i) {
+      shard_idx = shard_idx + 1 == Shards ? 0 : shard_idx + 1;
+      acquired += acquire_from(shard_idx, indices + acquired, count - acquired);
+    }
+    if (acquired > local) {
+      own.steals.fetch_add(acquired - local, std::memory_order_relaxed);
+    }
+    return acquired;
+  }
+
+  /// Marks the segment \param idx as free again.
+  inline void release(const std::size_t idx) noexcept {
+    const auto shard_idx = shard_of(idx);
+    const auto local_idx = idx - shard_begin(shard_idx);
+    bitmap::release(m_shards[shard_idx].words[local_idx / bitmap::bits],
+                    local_idx % bitmap::bits);
+  }
+
+  /// Marks the segment \param idx as used if it is free. \return if it was free.
+  inline bool try_acquire(const std::size_t idx) noexcept {
+    const auto shard_idx = shard_of(idx);
+    const auto local_idx = idx - shard_begin(shard_idx);
+    return bitmap::claim_bit(m_shards[shard_idx].words[local_idx / bitmap::bits],
+                             local_idx % bitmap::bits);
+  }
+
+  /// Marks the segment \param idx acquired by try_acquire() as free again.
+  inline void release_claimed(const std::size_t idx) noexcept {
+    release(idx);
+  }
+
+  /// \return if the segment \param idx is free.
+  inline bool is_free(const std::size_t idx) const noexcept {
+    const auto shard_idx = shard_of(idx);
+    const auto local_idx = idx - shard_begin(shard_idx);
+    return bitmap::is_free(m_shards[shard_idx].words[local_idx / bitmap::bits],
+                           local_idx % bitmap::bits);
+  }
+
+  /// Marks the \param count segments in \param indices as free again.
+  inline void release(const std::size_t *indices, const std::size_t count) noexcept {
+    for (std::size_t i = 0; i < count; ++i) {
+      release(indices[i]);
+    }
+  }
+
+  /// \return The number of used segments. Exact if no other thread modifies the pool.
+  inline std::size_t used() const noexcept {
+    std::size_t counter = std::size_t();
+    for (const auto &shard : m_shards) {
+      for (const auto &word : shard.words) {
+        counter += __builtin_popcountll(word.load(std::memory_order_relaxed));
+      }
+    }
+    return counter - m_padding;
+  }
+
+  /// Adds the counters of all shards to \param stats.
+  inline void collect(exception_memory::ShardStatistics &stats) const noexcept {
+    for (const auto &shard : m_shards) {
+      stats.local_hits += shard.local_hits.load(std::memory_order_relaxed);
+      stats.steals += shard.steals.load(std::memory_order_relaxed);
+    }
+  }
+
+  /// This allocator has no other counters.
+  template <typename Statistics>
+  inline void collect(Statistics &) const noexcept {}
+
+  private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, shard_words> words;
+    /// Segments acquired from this shard by its own threads.
+    Counter<EnableStatistics> local_hits{0};
+    /// Segments the threads of this shard took from other shards.
+    Counter<EnableStatistics> steals{0};
+  };
+
+  std::array<Shard, Shards> m_shards;
+  /// Number of bits which do not represent a segment.
+  std::size_t m_padding = 0;
+
+  /** Acquires up to \param count free segments from the shard \param shard_idx.
+   *  \return The number of acquired segments.
+   */
+  std::size_t acquire_from(const std::size_t shard_idx, std::size_t *indices,
+                           const std::size_t count) noexcept {
+    std::size_t acquired = std::size_t();
+    auto &shard = m_shards[shard_idx];
+    for (std::size_t i = 0; i < shard_words && acquired < count; ++i) {
+      for (auto claimed = bitmap::claim(shard.words[i], count - acquired); claimed != 0;
+           claimed &= claimed - 1) {
+        indices[acquired++] =
+            shard_begin(shard_idx) + i * bitmap::bits + __builtin_ctzll(claimed);
+      }
+    }
+    return acquired;
+  }
+
+  /// \return The index of the first segment of the shard \param shard_idx.
+  static constexpr std::size_t shard_begin(const std::size_t shard_idx) noexcept {
+    return shard_idx * (Size / Shards) + std::min(shard_idx, larger_shards);
+  }
+
+  /// \return The shard holding the segment \param idx.
+  static constexpr std::size_t shard_of(const std::size_t idx) noexcept {
+    // The larger shards come first, the others start at larger_shards * shard_size.
+    const auto split = larger_shards * shard_size;
+    return idx < split ? idx / shard_size : larger_shards + (idx - split) / (Size / Shards);
+  }
+
+  /// \return The shard of the calling thread, assigned round-robin on first use.
+  static std::size_t thread_shard() noexcept {
+    static std::atomic<std::size_t> registered_threads{0};
+    static const thread_local std::size_t t =
+        registered_threads.fetch_add(1, std::memory_order_relaxed) % Shards;
+    return t;
+  }
+};
+
+/** Hands out segment indices from a lock-free stack of free segments. The head of the stack
+ *  carries a generation tag which changes on every update, so a head which was popped and pushed
+ *  again in between cannot be mistaken for an unchanged one (ABA problem). Every segment carries
+ *  a state besides, which lets try_acquire() claim a free segment in the middle of the stack: it
+ *  stays linked and is skipped by the pop which finds it claimed.
+ *  \tparam Size Number of managed segments.
+ */
+template <std::size_t Size>
+class FreelistSegmentAllocator {
+  static_assert(Size < (std::uint64_t(1) << 32), "Segment indices must fit into 32 bits.");
+
+  public:
+  inline FreelistSegmentAllocator() noexcept {
+    for (std::size_t idx = 0; idx < Size; ++idx) {
+      m_next[idx].store(static_cast<std::uint32_t>(idx + 1), std::memory_order_relaxed);
+    }
+    m_head.store(pack(0, 0), std::memory_order_release);
+  }
+
+  /// \return The index of a free segment which is now marked as used or Size if none is free.
+  inline std::size_t acquire() noexcept {
+    auto head = m_head.load(std::memory_order_acquire);
+    while (index(head) != Size) {
+      // Might read a stale successor if another thread pops concurrently. The tag makes the
+      // exchange below fail in this case.
+      const auto next = m_next[index(head)].load(std::memory_order_relaxed);
+      if (m_head.compare_exchange_weak(head, pack(next, tag(head) + 1),
+          std::memory_order_acquire, std::memory_order_acquire)) {
+        if (take(index(head))) {
+          return index(head);
+        }
+        head = m_head.load(std::memory_order_acquire);
+      }
+    }
+    return Size;
+  }
+
+  /** Acquires up to \param count free segments and stores their indices in \param indices. The
+   *  segments are unlinked from the stack with a single exchange, claimed ones are dropped.
+   *  \return The number of acquired segments.
+   */
+  inline std::size_t acquire(std::size_t *indices, const std::size_t count) noexcept {
+    auto head = m_head.load(std::memory_order_acquire);
+    while (true) {
+      // Every modification of the stack changes the tag of the head, so the walked chain is
+      // consistent if the exchange below succeeds.
+      std::size_t acquired = std::size_t();
+      auto idx = index(head);
+      while (acquired < count && idx != Size) {
+        indices[acquired++] = idx;
+        idx = m_next[idx].load(std::memory_order_relaxed);
+      }
+      if (m_head.compare_exchange_weak(head, pack(idx, tag(head) + 1),
+          std::memory_order_acquire, std::memory_order_acquire)) {
+        std::size_t taken = std::size_t();
+        for (std::size_t i = 0; i < acquired; ++i) {
+          if (take(indices[i])) {
+            indices[taken++] = indices[i];
+          }
+        }
+        return taken;
+      }
+    }
+  }
+
+  /// Marks the segment \param idx as free again.
+  inline void release(const std::size_t idx) noexcept {
+    release(&idx, 1);
+  }
+
+  /** Marks the \param count segments in \param indices as free again. The segments are linked
+   *  to a chain first and then pushed with a single exchange.
+   */
+  inline void release(const std::size_t *indices, const std::size_t count) noexcept {
+    if (count == 0) {
+      return;
+    }
+    for (std::size_t i = 0; i + 1 < count; ++i) {
+      m_state[indices[i]].store(free_state, std::memory_order_relaxed);
+      m_next[indices[i]].store(static_cast<std::uint32_t>(indices[i + 1]),
+          std::memory_order_relaxed);
+    }
+    const auto last = indices[count - 1];
+    m_state[last].store(free_state, std::memory_order_relaxed);
+    auto head = m_head.load(std::memory_order_relaxed);
+    do {
+      m_next[last].store(index(head), std::memory_order_relaxed);
+    } while (!m_head.compare_exchange_weak(head,
+        pack(static_cast<std::uint32_t>(indices[0]), tag(head) + 1),
+        std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  /// Marks the segment \param idx as used if it is free, leaving it linked.
+  /// \return if it was free.
+  inline bool try_acquire(const std::size_t idx) noexcept {
+    auto state = m_state[idx].load(std::memory_order_relaxed);
+    return state == free_state && m_state[idx].compare_exchange_strong(state, claimed_state,
+        std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  /// Marks the segment \param idx acquired by try_acquire() as free again.
+  inline void release_claimed(const std::size_t idx) noexcept {
+    // The segment is still linked, unless a pop skipped it meanwhile.
+    auto state = claimed_state;
+    if (!m_state[idx].compare_exchange_strong(state, free_state, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+      release(idx);
+    }
+  }
+
+  /// \return if the segment \param idx is free.
+  inline bool is_free(const std::size_t idx) const noexcept {
+    return m_state[idx].load(std::memory_order_relaxed) == free_state;
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments.
+   */
+  inline std::size_t used() const noexcept {
+    std::size_t free = std::size_t();
+    for (auto idx = index(m_head.load()); idx != Size;
+         idx = m_next[idx].load(std::memory_order_relaxed)) {
+      ++free;
+    }
+    return Size - free;
+  }
+
+  /// This allocator has no counters.
+  template <typename Statistics>
+  inline void collect(Statistics &) const noexcept {}
+
+  private:
+  /// States of a segment. A claimed segment is still linked, a skipped one was claimed and then
+  /// popped, it is linked again when it is released.
+  static constexpr std::uint8_t free_state = 0;
+  static constexpr std::uint8_t used_state = 1;
+  static constexpr std::uint8_t claimed_state = 2;
+  static constexpr std::uint8_t skipped_state = 3;
+
+  /// Lower 32 bits: index of the first free segment. Upper 32 bits: generation tag.
+  std::atomic<std::uint64_t> m_head;
+  /// Index of the next free segment for every free segment.
+  std::array<std::atomic<std::uint32_t>, Size> m_next;
+  std::array<std::atomic<std::uint8_t>, Size> m_state{};
+
+  /// Marks the popped segment \param idx as used. \return false if it was claimed instead.
+  bool take(const std::size_t idx) noexcept {
+    for (;;) {
+      auto state = m_state[idx].load(std::memory_order_relaxed);
+      if (state == free_state ?
+          m_state[idx].compare_exchange_weak(state, used_state, std::memory_order_acquire,
+                                             std::memory_order_relaxed) :
+          m_state[idx].compare_exchange_weak(state, skipped_state, std::memory_order_relaxed,
+                                             std::memory_order_relaxed)) {
+        return state == free_state;
+      }
+    }
+  }
+
+  static std::uint64_t pack(const std::uint32_t idx, const std::uint32_t tag) noexcept {
+    return (std::uint64_t(tag) << 32) | idx;
+  }
+  static std::uint32_t index(const std::uint64_t head) noexcept {
+    return static_cast<std::uint32_t>(head);
+  }
+  static std::uint32_t tag(const std::uint64_t head) noexcept {
+    return static_cast<std::uint32_t>(head >> 32);
+  }
+};
+
+/** Puts a small cache of free segments per thread in front of a shared segment allocator. The
+ *  caches refill from and spill to the shared allocator in batches of half their capacity, so the
+ *  shared allocator is not touched on a steady throw/catch cycle. A thread returns the segments
+ *  of its cache when it exits.
+ *  \tparam SharedAllocator Segment allocator shared by all threads.
+ *  \tparam Size Number of managed segments.
+ *  \tparam Capacity Number of free segments a thread cache can hold.
+ *  \tparam MaxCaches Maximal number of threads owning a cache at the same time.
+ *  \tparam EnableStatistics Whether the hits and misses of the caches are counted.
+ */
+template <typename SharedAllocator, std::size_t Size, std::size_t Capacity, std::size_t MaxCaches,
+          bool EnableStatistics = true>
+class ThreadCachedSegmentAllocator {
+  static_assert(Capacity > 0, "A thread cache must be able to hold at least one segment.");
+
+  public:
+  static constexpr std::size_t batch_size = Capacity > 1 ? Capacity / 2 : 1;
+
+  inline ThreadCachedSegmentAllocator() noexcept {
+    // Keys below PTHREAD_KEY_2NDLEVEL_SIZE are stored without dynamic memory.
+    if (pthread_key_create(&m_key, &ThreadCachedSegmentAllocator::return_cache) != 0) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cerr << "Could not initalize exception memory thread caches. Terminating." << std::endl;
+#endif
+      std::terminate();
+    }
+  }
+
+  inline ~ThreadCachedSegmentAllocator() noexcept {
+    pthread_key_delete(m_key);
+  }
+
+  /// \return The index of a free segment which is now marked as used or Size if none is free.
+  inline std::size_t acquire() noexcept {
+    auto cache = thread_cache();
+    if (cache == nullptr) {
+      return m_shared.acquire();
+    }
+    if (cache->count == 0) {
+      increment(cache->allocate_misses);
+      cache->count = m_shared.acquire(cache->segments.data(), batch_size);
+      if (cache->count == 0) {
+        return Size;
+      }
+    }
+    else {
+      increment(cache->allocate_hits);
+    }
+    return cache->segments[--cache->count];
+  }
+
+  /// Marks the segment \param idx as free again.
+  inline void release(const std::size_t idx) noexcept {
+    auto cache = thread_cache();
+    if (cache == nullptr) {
+      m_shared.release(idx);
+      return;
+    }
+    if (cache->count == Capacity) {
+      increment(cache->free_misses);
+      cache->count -= batch_size;
+      m_shared.release(cache->segments.data() + cache->count, batch_size);
+    }
+    else {
+      increment(cache->free_hits);
+    }
+    cache->segments[cache->count++] = idx;
+  }
+
+  /// Marks the segment \param idx as used if the shared allocator holds it as free.
+  /// \return if it was free.
+  inline bool try_acquire(const std::size_t idx) noexcept {
+    return m_shared.try_acquire(idx);
+  }
+
+  /// Returns the segment \param idx acquired by try_acquire() to the shared allocator.
+  inline void release_claimed(const std::size_t idx) noexcept {
+    m_shared.release_claimed(idx);
+  }
+
+  /// \return if the shared allocator holds the segment \param idx as free.
+  inline bool is_free(const std::size_t idx) const noexcept {
+    return m_shared.is_free(idx);
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments. Segments held by thread caches count as free.
+   */
+  inline std::size_t used() const noexcept {
+    auto counter = m_shared.used();
+    for (const auto &cache : m_caches) {
+      counter -= cache.count;
+    }
+    return counter;
+  }
+
+  /// Adds the counters of all thread caches, including the ones of exited threads, to \param stats.
+  inline void collect(exception_memory::ThreadCacheStatistics &stats) const noexcept {
+    for (const auto &cache : m_caches) {
+      stats.allocate_hits += cache.allocate_hits.load(std::memory_order_relaxed);
+      stats.allocate_misses += cache.allocate_misses.load(std::memory_order_relaxed);
+      stats.free_hits += cache.free_hits.load(std::memory_order_relaxed);
+      stats.free_misses += cache.free_misses.load(std::memory_order_relaxed);
+    }
+  }
+
+  /// Adds the counters of the shared allocator to \param stats.
+  template <typename Statistics>
+  inline void collect(Statistics &stats) const noexcept {
+    m_shared.collect(stats);
+  }
+
+  private:
+  /// Free segments of one thread. Each cache lives on its own cache lines.
+  struct alignas(64) Cache {
+    ThreadCachedSegmentAllocator *owner = nullptr;
+    std::atomic_flag claimed = ATOMIC_FLAG_INIT;
+    std::size_t count = 0;
+    std::array<std::size_t, Capacity> segments;
+    // Only written by the owning thread, atomic so collect() can read them at any time.
+    Counter<EnableStatistics> allocate_hits{0};
+    Counter<EnableStatistics> allocate_misses{0};
+    Counter<EnableStatistics> free_hits{0};
+    Counter<EnableStatistics> free_misses{0};
+  };
+
+  SharedAllocator m_shared;
+  pthread_key_t m_key;
+  std::array<Cache, MaxCaches> m_caches;
+  /// Marks threads which found no unclaimed cache.
+  Cache m_no_cache;
+
+  /// \return The cache of the calling thread or nullptr if it does not own one.
+  Cache *thread_cache() noexcept {
+    auto cache = static_cast<Cache *>(pthread_getspecific(m_key));
+    if (cache == nullptr) {
+      cache = claim_cache();
+    }
+    return cache == &m_no_cache ? nullptr : cache;
+  }
+
+  /// \return An unclaimed cache for the calling thread or m_no_cache if all are claimed.
+  Cache *claim_cache() noexcept {
+    auto cache = &m_no_cache;
+    for (auto &elem : m_caches) {
+      if (!elem.claimed.test_and_set(std::memory_order_acquire)) {
+        elem.owner = this;
+        cache = &elem;
+        break;
+      }
+    }
+    pthread_setspecific(m_key, cache);
+    return cache;
+  }
+
+  /// Returns the segments of \param vcache to the shared allocator once its thread exits.
+  static void return_cache(void *vcache) noexcept {
+    auto cache = static_cast<Cache *>(vcache);
+    if (cache->owner == nullptr) {
+      return; // m_no_cache
+    }
+    cache->owner->m_shared.release(cache->segments.data(), cache->count);
+    cache->count = 0;
+    cache->claimed.clear(std::memory_order_release);
+  }
+
+  /// Increments \param counter which is only written by the calling thread.
+  static void increment(Counter<EnableStatistics> &counter) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+};
+
+/// \return The CPU the calling thread currently runs on. Might be outdated right after the call.
+inline std::size_t current_cpu() noexcept {
+#ifdef EXCEPTION_MEMORY__CXX_HAVE_RSEQ
+  // glibc registers an rseq area for every thread, the kernel keeps its cpu_id up to date.
+  if (__rseq_size > 0) {
+    const auto area = reinterpret_cast<const volatile struct rseq *>(
+        static_cast<const char *>(__builtin_thread_pointer()) + __rseq_offset);
+    const auto cpu = area->cpu_id;
+    if (static_cast<std::int32_t>(cpu) >= 0) {
+      return cpu;
+    }
+  }
+#endif
+  const auto cpu = sched_getcpu();
+  return cpu < 0 ? 0 : static_cast<std::size_t>(cpu);
+}
+
+/** Keeps a lock-free freelist of free segments per CPU in front of a shared segment allocator.
+ *  The freelist is chosen by the CPU the calling thread runs on, so the common path works on
+ *  memory only used by this core. Empty freelists refill from the shared allocator in batches.
+ *  If the shared allocator is exhausted too, segments are stolen from the freelists of other
+ *  CPUs, which covers segments left behind by threads migrating between CPUs.
+ *  \tparam SharedAllocator Segment allocator shared by all CPUs.
+ *  \tparam Size Number of managed segments.
+ *  \tparam MaxCpus Number of freelists. CPUs with a higher index share freelists.
+ *  \tparam EnableStatistics Whether the hits, refills and steals are counted.
+ */
+template <typename SharedAllocator, std::size_t Size, std::size_t MaxCpus,
+          bool EnableStatistics = true>
+class PerCpuSegmentAllocator {
+  static_assert(Size < (std::uint64_t(1) << 32), "Segment indices must fit into 32 bits.");
+
+  public:
+  static constexpr std::size_t batch_size = 8;
+
+  /// \return The index of a free segment which is now marked as used or Size if none is free.
+  inline std::size_t acquire() noexcept {
+    auto &list = m_lists[current_cpu() % MaxCpus];
+    auto idx = pop(list);
+    if (idx != Size) {
+      list.local_hits.fetch_add(1, std::memory_order_relaxed);
+      return idx;
+    }
+    std::array<std::size_t, batch_size> batch;
+    const auto acquired = m_shared.acquire(batch.data(), batch.size());
+    if (acquired > 0) {
+      list.refills.fetch_add(1, std::memory_order_relaxed);
+      for (std::size_t i = 1; i < acquired; ++i) {
+        push(list, batch[i]);
+      }
+      return batch[0];
+    }
+    for (auto &other : m_lists) {
+      idx = pop(other);
+      if (idx != Size) {
+        list.steals.fetch_add(1, std::memory_order_relaxed);
+        return idx;
+      }
+    }
+    return Size;
+  }
+
+  /** Acquires up to \param count free segments and stores their indices in \param indices.
+   *  \return The number of acquired segments.
+   */
+  inline std::size_t acquire(std::size_t *indices, const std::size_t count) noexcept {
+    std::size_t acquired = std::size_t();
+    while (acquired < count) {
+      const auto idx = acquire();
+      if (idx == Size) {
+        break;
+      }
+      indices[acquired++] = idx;
+    }
+    return acquired;
+  }
+
+  /// Marks the segment \param idx as free again by putting it on the freelist of the current CPU.
+  inline void release(const std::size_t idx) noexcept {
+    push(m_lists[current_cpu() % MaxCpus], idx);
+  }
+
+  /// Marks the \param count segments in \param indices as free again.
+  inline void release(const std::size_t *indices, const std::size_t count) noexcept {
+    for (std::size_t i = 0; i < count; ++i) {
+      release(indices[i]);
+    }
+  }
+
+  /// Marks the segment \param idx as used if the shared allocator holds it as free.
+  /// \return if it was free.
+  inline bool try_acquire(const std::size_t idx) noexcept {
+    return m_shared.try_acquire(idx);
+  }
+
+  /// Returns the segment \param idx acquired by try_acquire() to the shared allocator.
+  inline void release_claimed(const std::size_t idx) noexcept {
+    m_shared.release_claimed(idx);
+  }
+
+  /// \return if the shared allocator holds the segment \param idx as free.
+  inline bool is_free(const std::size_t idx) const noexcept {
+    return m_shared.is_free(idx);
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments. Segments on the CPU freelists count as free.
+   */
+  inline std::size_t used() const noexcept {
+    auto counter = m_shared.used();
+    for (const auto &list : m_lists) {
+      for (auto idx = index(list.head.load()); idx != nil;
+           idx = m_next[idx].load(std::memory_order_relaxed)) {
+        --counter;
+      }
+    }
+    return counter;
+  }
+
+  /// Adds the counters of all CPU freelists to \param stats.
+  inline void collect(exception_memory::PerCpuStatistics &stats) const noexcept {
+    for (const auto &list : m_lists) {
+      stats.local_hits += list.local_hits.load(std::memory_order_relaxed);
+      stats.refills += list.refills.load(std::memory_order_relaxed);
+      stats.steals += list.steals.load(std::memory_order_relaxed);
+    }
+  }
+
+  /// Adds the counters of the shared allocator to \param stats.
+  template <typename Statistics>
+  inline void collect(Statistics &stats) const noexcept {
+    m_shared.collect(stats);
+  }
+
+  private:
+  static constexpr std::uint32_t nil = ~std::uint32_t();
+
+  /// Freelist of one CPU. Each list lives on its own cache lines.
+  struct alignas(64) List {
+    /// Lower 32 bits: index of the first free segment. Upper 32 bits: generation tag.
+    std::atomic<std::uint64_t> head{nil};
+    Counter<EnableStatistics> local_hits{0};
+    Counter<EnableStatistics> refills{0};
+    Counter<EnableStatistics> steals{0};
+  };
+
+  SharedAllocator m_shared;
+  std::array<List, MaxCpus> m_lists;
+  /// Index of the next free segment for every segment on a freelist.
+  std::array<std::atomic<std::uint32_t>, Size> m_next;
+
+  /** Pops a segment from \param list. The exchange only fails if the thread migrated or a
+   *  thread steals from this list.
+   *  \return The index of the segment or Size if the list is empty.
+   */
+  std::size_t pop(List &list) noexcept {
+    auto head = list.head.load(std::memory_order_acquire);
+    while (index(head) != nil) {
+      const auto next = m_next[index(head)].load(std::memory_order_relaxed);
+      if (list.head.compare_exchange_weak(head, pack(next, tag(head) + 1),
+          std::memory_order_acquire, std::memory_order_acquire)) {
+        return index(head);
+      }
+    }
+    return Size;
+  }
+
+  /// Pushes the segment \param idx to \param list.
+  void push(List &list, const std::size_t idx) noexcept {
+    auto head = list.head.load(std::memory_order_relaxed);
+    do {
+      m_next[idx].store(index(head), std::memory_order_relaxed);
+    } while (!list.head.compare_exchange_weak(head,
+        pack(static_cast<std::uint32_t>(idx), tag(head) + 1),
+        std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  static std::uint64_t pack(const std::uint32_t idx, const std::uint32_t tag) noexcept {
+    return (std::uint64_t(tag) << 32) | idx;
+  }
+  static std::uint32_t index(const std::uint64_t head) noexcept {
+    return static_cast<std::uint32_t>(head);
+  }
+  static std::uint32_t tag(const std::uint64_t head) noexcept {
+    return static_cast<std::uint32_t>(head >> 32);
+  }
+};
+
+/** CPU to NUMA node mapping. Read from sysfs on first use and replaceable with
+ *  set_numa_topology(), e.g. to test NUMA placement on a single node machine.
+ */
+class NumaTopology {
+  public:
+  /// Number of node ids probed in sysfs.
+  static constexpr std::size_t max_nodes = 64;
+  static constexpr std::size_t max_cpus = EXCEPTION_MEMORY__CXX_MAX_CPUS;
+
+  inline NumaTopology() noexcept {
+    for (auto &node : m_cpu_to_node) {
+      node.store(0, std::memory_order_relaxed);
+    }
+    // Plain system calls only, this runs during static initialization.
+    for (std::size_t node = 0; node < max_nodes; ++node) {
+      char path[64] = "/sys/devices/system/node/node";
+      auto end = path + strlen(path);
+      if (node >= 10) {
+        *end++ = static_cast<char>('0' + node / 10);
+      }
+      *end++ = static_cast<char>('0' + node % 10);
+      strcpy(end, "/cpulist");
+      const auto fd = open(path, O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        continue;
+      }
+      char cpulist[4096];
+      const auto length = read(fd, cpulist, sizeof(cpulist));
+      close(fd);
+      if (length > 0) {
+        m_nodes |= std::uint64_t(1) << node;
+        parse_cpulist(cpulist, cpulist + length, node);
+      }
+    }
+  }
+
+  /// \return The NUMA node of the CPU \param cpu.
+  inline std::size_t node_of(const std::size_t cpu) const noexcept {
+    return m_cpu_to_node[cpu % max_cpus].load(std::memory_order_relaxed);
+  }
+
+  /// \return if the NUMA node \param node exists on this machine.
+  inline bool exists(const std::size_t node) const noexcept {
+    return node < max_nodes && (m_nodes & (std::uint64_t(1) << node)) != 0;
+  }
+
+  /// Replaces the node of the first \param cpus CPUs with the ones in \param cpu_to_node.
+  inline void set(const std::uint16_t *cpu_to_node, const std::size_t cpus) noexcept {
+    for (std::size_t cpu = 0; cpu < std::min(cpus, max_cpus); ++cpu) {
+      m_cpu_to_node[cpu].store(cpu_to_node[cpu], std::memory_order_relaxed);
+    }
+  }
+
+  private:
+  std::array<std::atomic<std::uint16_t>, max_cpus> m_cpu_to_node;
+  /// Bit mask of the existing nodes.
+  std::uint64_t m_nodes = 0;
+
+  /// Assigns all CPUs of the list in [\param it, \param end), e.g. "0-3,8-11", to \param node.
+  void parse_cpulist(const char *it, const char *end, const std::size_t node) noexcept {
+    const auto parse_number = [&it, end]() {
+      std::size_t number = std::size_t();
+      for (; it != end && *it >= '0' && *it <= '9'; ++it) {
+        number = number * 10 + static_cast<std::size_t>(*it - '0');
+      }
+      return number;
+    };
+    while (it != end) {
+      if (*it < '0' || *it > '9') {
+        ++it;
+        continue;
+      }
+      const auto first = parse_number();
+      auto last = first;
+      if (it != end && *it == '-') {
+        ++it;
+        last = parse_number();
+      }
+      for (auto cpu = first; cpu <= last && cpu < max_cpus; ++cpu) {
+        m_cpu_to_node[cpu].store(static_cast<std::uint16_t>(node), std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+/// \return The NUMA topology of this machine.
+inline NumaTopology &numa_topology() noexcept {
+  static NumaTopology topology;
+  return topology;
+}
+
+/** Faults in the pages of [\param begin, \param begin + \param size) for writing. Safe while
+ *  the memory is in use, its contents are left untouched.
+ */
+inline void populate(char *const begin, const std::size_t size) noexcept {
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(begin, size, MADV_POPULATE_WRITE) == 0) {
+    return;
+  }
+#endif
+  // Older kernels: write the unchanged value back to one byte of every page.
+  const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  for (std::size_t offset = 0; offset < size; offset += page_size) {
+    __atomic_fetch_or(begin + offset, 0, __ATOMIC_RELAXED);
+  }
+}
+
+/// Binds [\param data, \param data + \param size) to the NUMA node \param node.
+/// \return if the kernel accepted the binding.
+inline bool bind_memory(char *const data, const std::size_t size, const std::size_t node) noexcept {
+  constexpr std::size_t mask_bits = 8 * sizeof(unsigned long);
+  std::array<unsigned long, NumaTopology::max_nodes / mask_bits> mask{};
+  if (node >= mask.size() * mask_bits) {
+    return false;
+  }
+  mask[node / mask_bits] |= 1UL << (node % mask_bits);
+  return syscall(SYS_mbind, data, size, MPOL_BIND, mask.data(),
+                 mask.size() * mask_bits + 1, MPOL_MF_MOVE) == 0;
+}
+
+/** Returns the whole pages of \param page_size bytes in [\param offset, \param offset +
+ *  \param size) of the \param slab_size bytes at \param data to the kernel. A range ending at
+ *  the end of the slab includes its last page. The pages fault in again on their next use,
+ *  locked pages are not released.
+ *  \return The number of released bytes.
+ */
+inline std::size_t release_pages(char *const data, const std::size_t slab_size,
+                                 const std::size_t offset, const std::size_t size,
+                                 const std::size_t page_size) noexcept {
+  const auto end = offset + size;
+  const auto first_page = (offset + page_size - 1) / page_size * page_size;
+  const auto last_page = end == slab_size ? end : end / page_size * page_size;
+  if (first_page < last_page) {
+    const auto begin = data + first_page;
+    const auto length = last_page - first_page;
+#ifdef MADV_FREE
+    if (madvise(begin, length, MADV_FREE) == 0) {
+      return length;
+    }
+#endif
+    if (madvise(begin, length, MADV_DONTNEED) == 0) {
+      return length;
+    }
+  }
+  return 0;
+}
+
+template <typename Backing>
+class Slab;
+
+template <std::size_t Bytes, std::size_t Alignment>
+class StaticSlab;
+
+/// Memory backing policy: slabs live in static storage inside the pool object, so the pool
+/// needs no constructor work and can be constant-initialised into .bss.
+struct StaticBacking {
+  static constexpr bool huge_pages = false;
+  static constexpr std::size_t commit_chunk_size = 0;
+
+  template <std::size_t Bytes, std::size_t Alignment>
+  using SlabType = StaticSlab<Bytes, Alignment>;
+};
+
+/// Memory backing policy: slabs are allocated from the heap and committed at startup.
+struct HeapBacking {
+  static constexpr bool huge_pages = false;
+  static constexpr std::size_t commit_chunk_size = 0;
+
+  template <std::size_t Bytes, std::size_t Alignment>
+  using SlabType = Slab<HeapBacking>;
+};
+
+/// Memory backing policy: slabs are mapped with reserved or transparent 2 MiB pages.
+struct HugePageBacking {
+  static constexpr bool huge_pages = true;
+  static constexpr std::size_t commit_chunk_size = 0;
+
+  template <std::size_t Bytes, std::size_t Alignment>
+  using SlabType = Slab<HugePageBacking>;
+};
+
+/// Memory backing policy: slabs are reserved at startup and committed in chunks of ChunkSize
+/// bytes on first use.
+template <std::size_t ChunkSize>
+struct LazyCommitBacking {
+  static_assert(ChunkSize > 0, "Chunks must not be empty.");
+  static constexpr bool huge_pages = false;
+  static constexpr std::size_t commit_chunk_size = ChunkSize;
+
+  template <std::size_t Bytes, std::size_t Alignment>
+  using SlabType = Slab<LazyCommitBacking>;
+};
+
+/** Slab of \tparam Bytes bytes in static storage, rounded up to whole pages. It is zeroed, so
+ *  an object holding it lands in .bss, and it is never freed, so it stays valid until the
+ *  process exits. Provides the interface of Slab.
+ *  \tparam Alignment Alignment of the slab, at least a page.
+ */
+template <std::size_t Bytes, std::size_t Alignment>
+class StaticSlab {
+  static constexpr std::size_t page_size = 4096;
+
+  public:
+  /// The size and alignment are fixed by the template parameters, the arguments of the Slab
+  /// constructor are accepted for uniformity only.
+  constexpr StaticSlab(std::size_t, std::size_t) noexcept {}
+
+  StaticSlab( const StaticSlab& ) = delete;
+  StaticSlab& operator=( const StaticSlab& ) = delete;
+
+  /// \return The start of the slab.
+  inline char *data() const noexcept {
+    return const_cast<char *>(m_data);
+  }
+
+  /// \return The size of the slab in bytes.
+  static constexpr std::size_t size() noexcept {
+    return sizeof (m_data);
+  }
+
+  /// Binds the slab to the NUMA node \param node. \return if the kernel accepted the binding.
+  inline bool bind(const std::size_t node) noexcept {
+    return bind_memory(data(), size(), node);
+  }
+
+  /// Static slabs are always committed. \return true.
+  constexpr bool commit(std::size_t, std::size_t) noexcept {
+    return true;
+  }
+
+  /// \return The number of committed bytes.
+  static constexpr std::size_t committed() noexcept {
+    return size();
+  }
+
+  /** Faults in every page of the slab, so the first use of a segment does not take a page fault.
+   *  Safe while segments are in use, their contents are left untouched.
+   *  \return The number of prefaulted bytes.
+   */
+  inline std::size_t prefault() noexcept {
+    populate(data(), size());
+    return size();
+  }
+
+  /** Returns the whole pages in [\param offset, \param offset + \param size) to the kernel. The
+   *  range must not be in use. The released pages fault in again on their next use.
+   *  \return The number of released bytes.
+   */
+  inline std::size_t trim(const std::size_t offset, const std::size_t size) noexcept {
+    return release_pages(data(), this->size(), offset, size, trim_granularity());
+  }
+
+  /// \return The size of the aligned spans trim() releases as a whole, a page.
+  static std::size_t trim_granularity() noexcept {
+    return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  }
+
+  /// Locks the slab in RAM. \return 0 or the errno of the failed mlock call.
+  inline int lock() noexcept {
+    return mlock(data(), size()) == 0 ? 0 : errno;
+  }
+
+  /// Adds the backing of this slab to \param stats.
+  inline void collect(exception_memory::BackingStatistics &stats) const noexcept {
+    ++stats.static_slabs;
+  }
+
+  /// Adds the reserved and committed bytes of this slab to \param stats.
+  inline void collect(exception_memory::CommitStatistics &stats) const noexcept {
+    stats.reserved_bytes += size();
+    stats.committed_bytes += committed();
+  }
+
+  private:
+  alignas(std::max(Alignment, page_size))
+      char m_data[(Bytes + page_size - 1) / page_size * page_size]{};
+};
+
+/** Memory backing one segment pool. Always covers whole pages, so it can be bound to a NUMA
+ *  node on its own. With a LazyCommitBacking the slab is only reserved and committed chunk by
+ *  chunk on first use, with the other backings the commit checks compile to nothing.
+ *  \tparam Backing Memory backing policy.
+ */
+template <typename Backing>
+class Slab {
+  static constexpr bool lazy_commit = Backing::commit_chunk_size > 0;
+
+  public:
+  static constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+  /// Allocates at least \param bytes aligned to \param alignment.
+  inline Slab(const std::size_t bytes, const std::size_t alignment) noexcept {
+    const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    if constexpr (Backing::huge_pages) {
+      allocate_huge_pages(bytes);
+    }
+    else if constexpr (lazy_commit) {
+      reserve(bytes, page_size);
+    }
+    else {
+      m_page_size = page_size;
+      m_size = (bytes + page_size - 1) / page_size * page_size;
+      m_data = static_cast<char *>(aligned_alloc(std::max(alignment, page_size), m_size));
+      m_backing = Memory::heap;
+    }
+    if (m_data == nullptr) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cerr << "Could not initalize exception memory pool. Terminating." << std::endl;
+#endif
+      std::terminate();
+    }
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    static const char *const names[] = {
+      "heap", "pages", "huge pages", "transparent huge pages"};
+    std::cout << "Exception memory pool slab of " << m_size << " bytes backed by " <<
+      names[static_cast<int>(m_backing)] << "." << std::endl;
+#endif
+  }
+
+  inline ~Slab() noexcept {
+    if (m_backing == Memory::heap) {
+      free(m_data);
+    }
+    else {
+      munmap(m_data, m_size);
+    }
+    if constexpr (lazy_commit) {
+      if (m_chunks != nullptr) {
+        munmap(m_chunks, m_chunk_count * sizeof (std::atomic<ChunkState>));
+      }
+    }
+  }
+
+  Slab( const Slab& ) = delete;
+  Slab& operator=( const Slab& ) = delete;
+
+  /// \return The start of the slab.
+  inline char *data() const noexcept {
+    return m_data;
+  }
+
+  /// \return The size of the slab in bytes.
+  inline std::size_t size() const noexcept {
+    return m_size;
+  }
+
+  /// Binds the slab to the NUMA node \param node. \return if the kernel accepted the binding.
+  inline bool bind(const std::size_t node) noexcept {
+    return bind_memory(m_data, m_size, node);
+  }
+
+  /** Makes sure the chunks covering \param size bytes from \param offset on are committed.
+   *  Once a chunk is committed this is a single load per chunk.
+   *  \return false if a chunk could not be committed.
+   */
+  inline bool commit(const std::size_t offset, const std::size_t size) noexcept {
+    if constexpr (!lazy_commit) {
+      (void) offset;
+      (void) size;
+      return true;
+    }
+    const auto last = (offset + size - 1) / m_chunk_size;
+    for (auto chunk = offset / m_chunk_size; chunk <= last; ++chunk) {
+      if (m_chunks[chunk].load(std::memory_order_acquire) != ChunkState::committed &&
+          !commit_chunk(chunk)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// \return The number of committed bytes.
+  inline std::size_t committed() const noexcept {
+    return lazy_commit ? m_committed.load(std::memory_order_relaxed) : m_size;
+  }
+
+  /** Faults in every page of the slab, so the first use of a segment does not take a page fault.
+   *  Commits all chunks of a lazily committed slab. Safe while segments are in use, their
+   *  contents are left untouched.
+   *  \return The number of prefaulted bytes.
+   */
+  inline std::size_t prefault() noexcept {
+    if constexpr (lazy_commit) {
+      // Committing populates the pages of a chunk.
+      commit(0, m_size);
+      return committed();
+    }
+    populate(m_data, m_size);
+    return m_size;
+  }
+
+  /** Returns the memory in [\param offset, \param offset + \param size) to the kernel. The
+   *  range must not be in use. Chunks of a lazily committed slab are decommitted as a whole, so
+   *  they are prefaulted again when committed. Otherwise the whole pages in the range are
+   *  released and fault in again on their next use. Locked pages are not released.
+   *  \return The number of released bytes.
+   */
+  inline std::size_t trim(const std::size_t offset, const std::size_t size) noexcept {
+    if constexpr (lazy_commit) {
+      const auto end = offset + size;
+      std::size_t released = std::size_t();
+      const auto last = end == m_size ? m_chunk_count : end / m_chunk_size;
+      for (auto chunk = (offset + m_chunk_size - 1) / m_chunk_size; chunk < last; ++chunk) {
+        released += decommit_chunk(chunk);
+      }
+      return released;
+    }
+    return release_pages(m_data, m_size, offset, size, m_page_size);
+  }
+
+  /// \return The size of the aligned spans trim() releases as a whole, a chunk or a page.
+  inline std::size_t trim_granularity() const noexcept {
+    return lazy_commit ? m_chunk_size : m_page_size;
+  }
+
+  /// Locks the slab in RAM. \return 0 or the errno of the failed mlock call.
+  inline int lock() noexcept {
+    return mlock(m_data, m_size) == 0 ? 0 : errno;
+  }
+
+  /// Adds the backing of this slab to \param stats.
+  inline void collect(exception_memory::BackingStatistics &stats) const noexcept {
+    switch (m_backing) {
+      case Memory::heap: ++stats.heap_slabs; break;
+      case Memory::pages: ++stats.page_slabs; break;
+      case Memory::huge_pages: ++stats.huge_page_slabs; break;
+      case Memory::transparent_huge_pages: ++stats.transparent_huge_page_slabs; break;
+    }
+  }
+
+  /// Adds the reserved and committed bytes of this slab to \param stats.
+  inline void collect(exception_memory::CommitStatistics &stats) const noexcept {
+    stats.reserved_bytes += m_size;
+    stats.committed_bytes += committed();
+  }
+
+  private:
+  enum class Memory { heap, pages, huge_pages, transparent_huge_pages };
+  enum class ChunkState : std::uint8_t { reserved, committing, committed };
+
+  char *m_data = nullptr;
+  std::size_t m_size = 0;
+  Memory m_backing = Memory::heap;
+  /// Commit state of every chunk, only used with a lazy commit backing.
+  std::atomic<ChunkState> *m_chunks = nullptr;
+  std::size_t m_chunk_size = 0;
+  std::size_t m_chunk_count = 0;
+  std::atomic<std::size_t> m_committed{0};
+  /// Granularity in which the memory is returned to the kernel.
+  std::size_t m_page_size = 0;
+
+  /// Maps at least \param bytes with reserved huge pages or else transparent huge pages.
+  void allocate_huge_pages(const std::size_t bytes) noexcept {
+    m_page_size = huge_page_size;
+    m_size = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+    auto data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data != MAP_FAILED) {
+      m_data = static_cast<char *>(data);
+      m_backing = Memory::huge_pages;
+      return;
+    }
+    // No huge pages reserved. Transparent huge pages need a huge page aligned range, so map
+    // one huge page more and cut off the unaligned head and tail.
+    data = mmap(nullptr, m_size + huge_page_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data != MAP_FAILED) {
+      const auto begin = reinterpret_cast<std::uintptr_t>(data);
+      const auto aligned = (begin + huge_page_size - 1) / huge_page_size * huge_page_size;
+      if (aligned != begin) {
+        munmap(data, aligned - begin);
+      }
+      munmap(reinterpret_cast<void *>(aligned + m_size), begin + huge_page_size - aligned);
+      m_data = reinterpret_cast<char *>(aligned);
+      m_backing = madvise(m_data, m_size, MADV_HUGEPAGE) == 0 ?
+          Memory::transparent_huge_pages : Memory::pages;
+    }
+  }
+
+  /// Reserves at least \param bytes of whole pages of \param page_size bytes without committing.
+  void reserve(const std::size_t bytes, const std::size_t page_size) noexcept {
+    m_page_size = page_size;
+    m_size = (bytes + page_size - 1) / page_size * page_size;
+    m_chunk_size = (Backing::commit_chunk_size + page_size - 1) / page_size * page_size;
+    m_chunk_count = (m_size + m_chunk_size - 1) / m_chunk_size;
+    const auto data = mmap(nullptr, m_size, PROT_NONE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    const auto chunks = mmap(nullptr, m_chunk_count * sizeof (std::atomic<ChunkState>),
+                             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data != MAP_FAILED && chunks != MAP_FAILED) {
+      m_data = static_cast<char *>(data);
+      m_chunks = static_cast<std::atomic<ChunkState> *>(chunks);
+      for (std::size_t chunk = 0; chunk < m_chunk_count; ++chunk) {
+        new (&m_chunks[chunk]) std::atomic<ChunkState>(ChunkState::reserved);
+      }
+      m_backing = Memory::pages;
+    }
+  }
+
+  /** Decommits \param chunk if it is committed and no thread commits it concurrently.
+   *  \return The number of decommitted bytes.
+   */
+  std::size_t decommit_chunk(const std::size_t chunk) noexcept {
+    auto expected = ChunkState::committed;
+    if (!m_chunks[chunk].compare_exchange_strong(expected, ChunkState::committing,
+                                                 std::memory_order_acquire)) {
+      return 0;
+    }
+    const auto begin = m_data + chunk * m_chunk_size;
+    const auto size = std::min(m_chunk_size, m_size - chunk * m_chunk_size);
+    if (madvise(begin, size, MADV_DONTNEED) != 0 || mprotect(begin, size, PROT_NONE) != 0) {
+      m_chunks[chunk].store(ChunkState::committed, std::memory_order_release);
+      return 0;
+    }
+    m_committed.fetch_sub(size, std::memory_order_relaxed);
+    m_chunks[chunk].store(ChunkState::reserved, std::memory_order_release);
+    return size;
+  }
+
+  /** Commits and prefaults \param chunk unless another thread did. Threads needing a chunk
+   *  another thread is committing wait for it.
+   *  \return false if the chunk could not be committed.
+   */
+  bool commit_chunk(const std::size_t chunk) noexcept {
+    auto &state = m_chunks[chunk];
+    for (;;) {
+      auto expected = ChunkState::reserved;
+      if (state.compare_exchange_weak(expected, ChunkState::committing,
+                                      std::memory_order_acquire, std::memory_order_acquire)) {
+        const auto begin = m_data + chunk * m_chunk_size;
+        const auto size = std::min(m_chunk_size, m_size - chunk * m_chunk_size);
+        const auto committed = mprotect(begin, size, PROT_READ | PROT_WRITE) == 0;
+        if (committed) {
+          populate(begin, size);
+          m_committed.fetch_add(size, std::memory_order_relaxed);
+        }
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+        else {
+          std::cerr << "Could not commit exception memory pool chunk." << std::endl;
+        }
+#endif
+        state.store(committed ? ChunkState::committed : ChunkState::reserved,
+                    std::memory_order_release);
+        return committed;
+      }
+      if (expected == ChunkState::committed) {
+        return true;
+      }
+      sched_yield();
+    }
+  }
+};
+
+/// Alignment of the thrown exception objects.
+static constexpr std::size_t object_alignment = EXCEPTION_MEMORY__CXX_OBJECT_ALIGNMENT;
+/// Size of the internal header in front of every exception object.
+static constexpr std::size_t header_size = sizeof (__cxxabiv1::__cxa_refcounted_exception);
+/// Size of the tag naming the quota an exception is charged to, right before its header.
+static constexpr std::size_t owner_tag_size =
+    EXCEPTION_MEMORY__CXX_THREAD_QUOTA > 0 ? sizeof (void *) : 0;
+/// Offset of the exception object from the start of its segment. The header ends right there.
+static constexpr std::size_t object_offset =
+    (header_size + owner_tag_size + object_alignment - 1) / object_alignment * object_alignment;
+
+static_assert((object_alignment & (object_alignment - 1)) == 0,
+    "The object alignment must be a power of two.");
+static_assert(object_alignment >= alignof (__cxxabiv1::__cxa_refcounted_exception),
+    "The object alignment must keep the exception header aligned.");
+static_assert(object_alignment <= EXCEPTION_MEMORY__CXX_CACHE_LINE_SIZE,
+    "The object alignment can be at most a cache line.");
+
+/** \return The distance between two neighbouring segments of \param segment_size bytes aligned
+ *  to \param alignment. With EXCEPTION_MEMORY__CXX_COLOUR_SLOTS it is an odd number of cache
+ *  lines, so the segment starts cycle through all cache sets instead of hitting the same few.
+ */
+constexpr std::size_t segment_stride(const std::size_t segment_size,
+                                     const std::size_t alignment) noexcept {
+#ifdef EXCEPTION_MEMORY__CXX_COLOUR_SLOTS
+  constexpr std::size_t line = EXCEPTION_MEMORY__CXX_CACHE_LINE_SIZE;
+  const auto lines = (std::max(segment_size, alignment) + line - 1) / line;
+  return (lines | 1) * line;
+#else
+  return (segment_size + alignment - 1) / alignment * alignment;
+#endif
+}
+
+/// Slot search strategy: probing an occupancy bitmap, see ProbingSegmentAllocator.
+struct ProbingSearch {
+  template <std::size_t Size, typename StartIndex, bool EnableStatistics>
+  using Allocator = ProbingSegmentAllocator<Size, StartIndex>;
+};
+
+/// Slot search strategy: popping a lock-free freelist, see FreelistSegmentAllocator.
+struct FreelistSearch {
+  template <std::size_t Size, typename StartIndex, bool EnableStatistics>
+  using Allocator = FreelistSegmentAllocator<Size>;
+};
+
+/// Slot search strategy: probing a sharded occupancy bitmap, see ShardedSegmentAllocator.
+template <std::size_t Shards>
+struct ShardedSearch {
+  template <std::size_t Size, typename StartIndex, bool EnableStatistics>
+  using Allocator = ShardedSegmentAllocator<Size, Shards, EnableStatistics>;
+};
+
+/// Slot search strategy: per thread caches in front of \tparam Search, see
+/// ThreadCachedSegmentAllocator.
+template <typename Search, std::size_t Capacity, std::size_t MaxCaches>
+struct ThreadCachedSearch {
+  template <std::size_t Size, typename StartIndex, bool EnableStatistics>
+  using Allocator = ThreadCachedSegmentAllocator<
+      typename Search::template Allocator<Size, StartIndex, EnableStatistics>, Size, Capacity,
+      MaxCaches, EnableStatistics>;
+};
+
+/// Slot search strategy: per CPU freelists in front of \tparam Search, see
+/// PerCpuSegmentAllocator.
+template <typename Search, std::size_t MaxCpus>
+struct PerCpuSearch {
+  template <std::size_t Size, typename StartIndex, bool EnableStatistics>
+  using Allocator = PerCpuSegmentAllocator<
+      typename Search::template Allocator<Size, StartIndex, EnableStatistics>, Size, MaxCpus,
+      EnableStatistics>;
+};
+
+/** Policies the memory pool is built from. Features a policy does not use compile to nothing.
+ *  \tparam Search Slot search strategy, e.g. ProbingSearch.
+ *  \tparam StartIndexPolicy Where the probing search starts, e.g. ThreadStartIndex.
+ *  \tparam BackingPolicy Memory backing of the slabs, e.g. HeapBacking.
+ *  \tparam EnableStatistics Whether the counters of the statistics are maintained.
+ */
+template <typename Search, typename StartIndexPolicy, typename BackingPolicy,
+          bool EnableStatistics>
+struct PoolPolicies {
+  using StartIndex = StartIndexPolicy;
+  using Backing = BackingPolicy;
+  static constexpr bool statistics = EnableStatistics;
+
+  /// Segment allocator of a pool of \tparam Size segments.
+  template <std::size_t Size>
+  using SegmentAllocator = typename Search::template Allocator<Size, StartIndex, statistics>;
+};
+
+#if defined(EXCEPTION_MEMORY__CXX_USE_FREELIST)
+using DefaultSharedSearch = FreelistSearch;
+#elif EXCEPTION_MEMORY__CXX_SHARDS > 0
+using DefaultSharedSearch = ShardedSearch<EXCEPTION_MEMORY__CXX_SHARDS>;
+#else
+using DefaultSharedSearch = ProbingSearch;
+#endif
+#if EXCEPTION_MEMORY__CXX_THREAD_CACHE_SIZE > 0
+using DefaultSearch = ThreadCachedSearch<DefaultSharedSearch, EXCEPTION_MEMORY__CXX_THREAD_CACHE_SIZE,
+                                         EXCEPTION_MEMORY__CXX_MAX_THREAD_CACHES>;
+#elif defined(EXCEPTION_MEMORY__CXX_PER_CPU_FREELISTS)
+using DefaultSearch = PerCpuSearch<DefaultSharedSearch, EXCEPTION_MEMORY__CXX_MAX_CPUS>;
+#else
+using DefaultSearch = DefaultSharedSearch;
+#endif
+#if defined(EXCEPTION_MEMORY__CXX_USE_HUGE_PAGES)
+using DefaultBacking = HugePageBacking;
+#elif EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE > 0
+using DefaultBacking = LazyCommitBacking<EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE>;
+#else
+using DefaultBacking = StaticBacking;
+#endif
+
+/// Policies chosen by the EXCEPTION_MEMORY__CXX_* defines.
+using DefaultPolicies = PoolPolicies<DefaultSearch, ThreadStartIndex, DefaultBacking, true>;
+
+// Set if the memory pool needs no constructor work, so it is constant-initialised into .bss.
+// Freelists, thread caches, mapped slabs, NUMA binding, prefaulting at startup, the runtime
+// geometry and the thread quotas all set up state when the pool is constructed.
+#if !defined(EXCEPTION_MEMORY__CXX_USE_FREELIST) && EXCEPTION_MEMORY__CXX_SHARDS == 0 && \
+    EXCEPTION_MEMORY__CXX_THREAD_CACHE_SIZE == 0 && \
+    !defined(EXCEPTION_MEMORY__CXX_PER_CPU_FREELISTS) && \
+    !defined(EXCEPTION_MEMORY__CXX_USE_HUGE_PAGES) && EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE == 0 && \
+    EXCEPTION_MEMORY__CXX_NUMA_NODES == 0 && !defined(EXCEPTION_MEMORY__CXX_PREFAULT_AND_LOCK) && \
+    !defined(EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY) && EXCEPTION_MEMORY__CXX_THREAD_QUOTA == 0
+#define EXCEPTION_MEMORY___CXX_CONSTANT_INIT
+#endif
+
+/** Storage of a \tparam T whose destructor never runs, so the object stays valid until the
+ *  process exits, also for static destructors running after the one of the storage.
+ */
+template <typename T>
+union NeverDestroyed {
+  inline NeverDestroyed() noexcept : value() {}
+  inline ~NeverDestroyed() noexcept {}
+
+  T value;
+};
+
+/** Serializes the trims of a pool and lets allocations which find the pool exhausted while a
+ *  trim holds its free blocks wait for them instead of failing, which only the large exception
+ *  arena does. Waiting blocks on a futex, so a preempted trimming thread of lower priority gets
+ *  to run.
+ */
+class TrimGate {
+  public:
+  constexpr TrimGate() noexcept = default;
+
+  TrimGate( const TrimGate& ) = delete;
+  TrimGate& operator=( const TrimGate& ) = delete;
+
+  /// Starts a trim. \return false if another thread trims the pool.
+  inline bool try_begin() noexcept {
+    auto state = idle;
+    return m_state.compare_exchange_strong(state, trimming, std::memory_order_acquire,
+                                           std::memory_order_relaxed);
+  }
+
+  /// Wakes the allocations waiting for segments, called whenever the trim released some.
+  inline void progress() noexcept {
+    auto state = waiting;
+    if (m_state.compare_exchange_strong(state, trimming, std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+      wake();
+    }
+  }
+
+  /// Ends the trim and wakes the waiting allocations.
+  inline void end() noexcept {
+    if (m_state.exchange(idle, std::memory_order_release) == waiting) {
+      wake();
+    }
+  }
+
+  /** Waits until a running trim releases segments.
+   *  \return false if no trim is running, the pool is exhausted then.
+   */
+  inline bool wait() noexcept {
+    auto state = m_state.load(std::memory_order_acquire);
+    while (state != idle) {
+      if (state == trimming && !m_state.compare_exchange_weak(state, waiting,
+                                                              std::memory_order_acquire)) {
+        continue;
+      }
+      syscall(SYS_futex, &m_state, FUTEX_WAIT_PRIVATE, waiting, nullptr, nullptr, 0);
+      return true;
+    }
+    return false;
+  }
+
+  private:
+  static constexpr std::uint32_t idle = 0;
+  static constexpr std::uint32_t trimming = 1;
+  /// A trim is running and allocations wait for it.
+  static constexpr std::uint32_t waiting = 2;
+
+  static_assert(sizeof (std::atomic<std::uint32_t>) == sizeof (std::uint32_t),
+      "The trim state is used as futex.");
+  std::atomic<std::uint32_t> m_state{idle};
+
+  void wake() noexcept {
+    syscall(SYS_futex, &m_state, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+  }
+};
+
+/** Lock for the short critical sections on the throwing path. It spins briefly and then sleeps
+ *  on a futex, so a waiting thread of higher priority lets a preempted holder of lower priority
+ *  run instead of spinning on its core forever.
+ */
+class FutexLock {
+  public:
+  constexpr FutexLock() noexcept = default;
+
+  FutexLock( const FutexLock& ) = delete;
+  FutexLock& operator=( const FutexLock& ) = delete;
+
+  inline void lock() noexcept {
+    for (std::size_t spin = 0; spin < spins; ++spin) {
+      auto state = m_state.load(std::memory_order_relaxed);
+      if (state == unlocked && m_state.compare_exchange_weak(state, locked,
+                                                              std::memory_order_acquire,
+                                                              std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    // Marks the lock as contended, so unlock() wakes this thread.
+    while (m_state.exchange(contended, std::memory_order_acquire) != unlocked) {
+      syscall(SYS_futex, &m_state, FUTEX_WAIT_PRIVATE, contended, nullptr, nullptr, 0);
+    }
+  }
+
+  inline void unlock() noexcept {
+    if (m_state.exchange(unlocked, std::memory_order_release) == contended) {
+      syscall(SYS_futex, &m_state, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+  }
+
+  private:
+  static constexpr std::uint32_t unlocked = 0;
+  static constexpr std::uint32_t locked = 1;
+  /// Locked and threads may sleep on the futex.
+  static constexpr std::uint32_t contended = 2;
+  static constexpr std::size_t spins = 100;
+
+  static_assert(sizeof (std::atomic<std::uint32_t>) == sizeof (std::uint32_t),
+      "The lock state is used as futex.");
+  std::atomic<std::uint32_t> m_state{unlocked};
+};
+
+/** Number of used segments of a pool and its peak since the last trim, from which trim_segments()
+ *  derives the high-water mark. Counting starts with the first trim, so pools which are never
+ *  trimmed only pay a relaxed load per allocation and free. Afterwards allocations raise the peak
+ *  with a relaxed fetch_max, which only writes when the count exceeds it.
+ */
+class SegmentUsage {
+  public:
+  constexpr SegmentUsage() noexcept = default;
+
+  SegmentUsage( const SegmentUsage& ) = delete;
+  SegmentUsage& operator=( const SegmentUsage& ) = delete;
+
+  /// Counts an allocated segment.
+  inline void allocated() noexcept {
+    if (!m_counting.load(std::memory_order_relaxed)) {
+      return;
+    }
+    const auto used = m_used.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto peak = m_peak.load(std::memory_order_relaxed);
+    while (used > peak &&
+           !m_peak.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+    }
+  }
+
+  /// Counts a freed segment.
+  inline void freed() noexcept {
+    if (m_counting.load(std::memory_order_relaxed)) {
+      m_used.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// \return if the segments are counted.
+  inline bool counting() const noexcept {
+    return m_counting.load(std::memory_order_relaxed);
+  }
+
+  /// Starts counting at \param used segments, called by the first trim.
+  inline void start(const std::size_t used) noexcept {
+    m_used.store(static_cast<std::ptrdiff_t>(used), std::memory_order_relaxed);
+    m_peak.store(static_cast<std::ptrdiff_t>(used), std::memory_order_relaxed);
+    m_counting.store(true, std::memory_order_relaxed);
+  }
+
+  /// \return The number of used segments. Frees racing with start() may leave it below zero.
+  inline std::size_t used() const noexcept {
+    return static_cast<std::size_t>(std::max<std::ptrdiff_t>(
+        m_used.load(std::memory_order_relaxed), 0));
+  }
+
+  /// \return The peak since the last call, the peak restarts at the current count.
+  inline std::size_t take_peak() noexcept {
+    const auto peak = m_peak.exchange(m_used.load(std::memory_order_relaxed),
+                                      std::memory_order_relaxed);
+    return static_cast<std::size_t>(std::max<std::ptrdiff_t>(peak, 0));
+  }
+
+  private:
+  std::atomic<bool> m_counting{false};
+  std::atomic<std::ptrdiff_t> m_used{0};
+  std::atomic<std::ptrdiff_t> m_peak{0};
+};
+
+/** Returns the pages of the free segments of \param segments beyond the decaying high-water mark
+ *  \param high_water to the kernel. The mark is the peak of used segments recorded by \param
+ *  usage since the last trim or half the previous mark if that is higher, and the lowest free
+ *  segments up to it stay resident. Only the free segments after them are claimed, the ones
+ *  overlapping a span of the trim granularity of \param slab at a time and only while the pages
+ *  of the span are released, so allocations find the resident segments available and never wait
+ *  for a trim. Segments the allocator cannot claim without waiting, like the ones in thread
+ *  caches, are skipped.
+ *  \return The number of bytes returned to the kernel.
+ */
+template <typename SegmentAllocator, typename SlabType>
+std::size_t trim_segments(SegmentAllocator &segments, SlabType &slab, SegmentUsage &usage,
+                          const std::size_t size, const std::size_t segment_size,
+                          std::size_t &high_water) noexcept {
+  if (!usage.counting()) {
+    std::size_t free = std::size_t();
+    for (std::size_t idx = 0; idx < size; ++idx) {
+      free += segments.is_free(idx) ? 1 : 0;
+    }
+    usage.start(size - free);
+  }
+  const auto used = usage.used();
+  high_water = std::max(usage.take_peak(), high_water / 2);
+  // Keep the lowest free segments resident.
+  auto resident = high_water > used ? high_water - used : std::size_t();
+  std::size_t first = std::size_t();
+  for (; first < size && resident > 0; ++first) {
+    if (segments.is_free(first)) {
+      --resident;
+    }
+  }
+  std::size_t released = std::size_t();
+  const auto granularity = slab.trim_granularity();
+  while (first < size) {
+    // The segments overlapping the span after the one of the first segment, a segment crossing
+    // the end of the span is claimed again with the next one.
+    const auto span_end = (first * segment_size / granularity + 1) * granularity;
+    const auto end = std::min((span_end + segment_size - 1) / segment_size, size);
+    auto run = first;
+    for (auto idx = first; idx <= end; ++idx) {
+      if (idx < end && segments.try_acquire(idx)) {
+        continue;
+      }
+      if (run < idx) {
+        released += slab.trim(run * segment_size, (idx - run) * segment_size);
+        for (; run < idx; ++run) {
+          segments.release_claimed(run);
+        }
+      }
+      run = idx + 1;
+    }
+    first = std::max(span_end / segment_size, first + 1);
+  }
+  return released;
+}
+
+/** Contiguous slab of equally sized segments together with the bookkeeping which of them are
+ *  in use. Mapping a pointer to its segment is pure address arithmetic.
+ *  \tparam SegmentSize Usable size of every segment.
+ *  \tparam Size Number of segments.
+ *  \tparam Policies Segment allocator and memory backing, see PoolPolicies.
+ */
+template <std::size_t SegmentSize, std::size_t Size, typename Policies = DefaultPolicies>
+class SegmentPool {
+  public:
+  static constexpr std::size_t size = Size;
+  /// Largest allocation a segment can hold.
+  static constexpr std::size_t max_size = SegmentSize;
+  /// Alignment of every segment. Aligning the segments aligns the exception objects in them.
+  static constexpr std::size_t alignment =
+      std::max<std::size_t>(EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT, object_alignment);
+  /// Distance between two neighbouring segments in the slab. Keeps every segment aligned.
+  static constexpr std::size_t segment_size = segment_stride(SegmentSize, alignment);
+
+#ifdef EXCEPTION_MEMORY__CXX_COLOUR_SLOTS
+  static_assert(EXCEPTION_MEMORY__CXX_CACHE_LINE_SIZE % alignment == 0,
+      "Coloured segments can be aligned to at most a cache line.");
+#endif
+
+  using SegmentAllocator = typename Policies::template SegmentAllocator<Size>;
+
+  constexpr SegmentPool() noexcept : m_slab(segment_size * Size, alignment) {}
+
+  SegmentPool( const SegmentPool& ) = delete;
+  SegmentPool& operator=( const SegmentPool& ) = delete;
+
+  /// \return A free segment which is now marked as used or nullptr if all are in use.
+  inline void *allocate() noexcept {
+    const auto idx = m_segments.acquire();
+    if (idx == Size) {
+      return nullptr;
+    }
+    if (!m_slab.commit(idx * segment_size, segment_size)) {
+      m_segments.release(idx);
+      return nullptr;
+    }
+    m_usage.allocated();
+    return segment(idx);
+  }
+
+  /// Marks the segment \param ptr as free again. \return false if \param ptr is no segment of
+  /// this pool.
+  inline bool deallocate(void *ptr) noexcept {
+    const auto idx = segment_idx(ptr);
+    if (idx == Size) {
+      return false;
+    }
+    m_usage.freed();
+    m_segments.release(idx);
+    return true;
+  }
+
+  /// \returns if \param ptr is the start of a segment of this pool.
+  inline bool owns(const void *ptr) const noexcept {
+    return segment_idx(ptr) != Size;
+  }
+
+  /// Binds the slab to the NUMA node \param node. \return if the kernel accepted the binding.
+  inline bool bind(const std::size_t node) noexcept {
+    return m_slab.bind(node);
+  }
+
+  /// Calls \param function with the slab of this pool.
+  template <typename Function>
+  inline void for_each_slab(Function &&function) noexcept {
+    function(m_slab);
+  }
+
+  /** Returns the pages of free segments to the kernel. The free segments up to the high-water
+   *  mark of used segments stay resident, the mark follows the peaks recorded by the allocations
+   *  since the previous call and halves with every call. Segments in the thread caches of other
+   *  threads are kept. Allocations never wait for a trim, see trim_segments(). Returns
+   *  immediately if another thread trims this pool.
+   *  \return The number of bytes returned to the kernel.
+   */
+  inline std::size_t trim() noexcept {
+    if (!m_trim.try_begin()) {
+      return 0;
+    }
+    const auto released = trim_segments(m_segments, m_slab, m_usage, Size, segment_size,
+                                        m_high_water);
+    m_trim.end();
+    return released;
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments.
+   */
+  inline std::size_t used_segments() const noexcept {
+    return m_segments.used();
+  }
+
+  /// Adds the backing of the slab to \param stats.
+  inline void collect(exception_memory::BackingStatistics &stats) const noexcept {
+    m_slab.collect(stats);
+  }
+
+  /// Adds the reserved and committed bytes of the slab to \param stats.
+  inline void collect(exception_memory::CommitStatistics &stats) const noexcept {
+    m_slab.collect(stats);
+  }
+
+  /// Adds the counters of the segment allocator to \param stats.
+  template <typename Statistics>
+  inline void collect(Statistics &stats) const noexcept {
+    m_segments.collect(stats);
+  }
+
+  private:
+  typename Policies::Backing::template SlabType<segment_size * Size, alignment> m_slab;
+  SegmentAllocator m_segments;
+  SegmentUsage m_usage;
+  TrimGate m_trim;
+  /// High-water mark of trim(), only accessed by the thread which started a trim at m_trim.
+  std::size_t m_high_water = 0;
+
+  /// \return The start of the segment with index \param idx.
+  char *segment(const std::size_t idx) const noexcept {
+    return m_slab.data() + idx * segment_size;
+  }
+
+  /** \return The index of the segment starting at \param ptr or Size if \param ptr is not the
+   *  start of a segment of this pool.
+   */
+  std::size_t segment_idx(const void *ptr) const noexcept {
+    // Pointers below the slab wrap around and fail the range check as well.
+    const auto offset = reinterpret_cast<std::uintptr_t>(ptr) -
+        reinterpret_cast<std::uintptr_t>(m_slab.data());
+    if (offset >= segment_size * Size || offset % segment_size != 0) {
+      return Size;
+    }
+    return offset / segment_size;
+  }
+};
+
+
+/** Segment pool split into one partition per NUMA node. The slab of every partition is bound to
+ *  its node, and allocations prefer the partition of the node the calling thread runs on. Only
+ *  if it is exhausted the other partitions are used.
+ *  \tparam SegmentSize Usable size of every segment.
+ *  \tparam Size Number of segments, rounded up to a multiple of Nodes.
+ *  \tparam Nodes Number of partitions. Partition n is bound to node n if it exists, threads
+ *  running on node n use partition n modulo Nodes.
+ *  \tparam Policies Policies of the partitions, see PoolPolicies.
+ */
+template <std::size_t SegmentSize, std::size_t Size, std::size_t Nodes,
+          typename Policies = DefaultPolicies>
+class NumaSegmentPool {
+  static constexpr std::size_t node_size = (Size + Nodes - 1) / Nodes;
+  using NodePool = SegmentPool<SegmentSize, node_size, Policies>;
+
+  public:
+  static constexpr std::size_t size = node_size * Nodes;
+  static constexpr std::size_t max_size = NodePool::max_size;
+  static constexpr std::size_t alignment = NodePool::alignment;
+  static constexpr std::size_t segment_size = NodePool::segment_size;
+
+  inline NumaSegmentPool() noexcept {
+    for (std::size_t node = 0; node < Nodes; ++node) {
+      if (numa_topology().exists(node)) {
+        if (m_nodes[node].bind(node)) {
+          ++m_bound_nodes;
+        }
+        else {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+          std::cerr << "Could not bind exception memory pool to NUMA node " << node << "." <<
+            std::endl;
+#endif
+          ++m_bind_failures;
+        }
+      }
+    }
+  }
+
+  NumaSegmentPool( const NumaSegmentPool& ) = delete;
+  NumaSegmentPool& operator=( const NumaSegmentPool& ) = delete;
+
+  /// \return A free segment which is now marked as used or nullptr if all are in use.
+  inline void *allocate() noexcept {
+    const auto local = numa_topology().node_of(current_cpu()) % Nodes;
+    auto ret = m_nodes[local].allocate();
+    if (ret != nullptr) {
+      m_counters[local].local_hits.fetch_add(1, std::memory_order_relaxed);
+      return ret;
+    }
+    for (std::size_t node = 0; node < Nodes; ++node) {
+      if (node != local) {
+        ret = m_nodes[node].allocate();
+        if (ret != nullptr) {
+          m_counters[local].remote_hits.fetch_add(1, std::memory_order_relaxed);
+          return ret;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  /// Marks the segment \param ptr as free again. \return false if \param ptr is no segment of
+  /// this pool.
+  inline bool deallocate(void *ptr) noexcept {
+    for (auto &node : m_nodes) {
+      if (node.deallocate(ptr)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// \returns if \param ptr is the start of a segment of this pool.
+  inline bool owns(const void *ptr) const noexcept {
+    for (const auto &node : m_nodes) {
+      if (node.owns(ptr)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Calls \param function with the slab of every partition.
+  template <typename Function>
+  inline void for_each_slab(Function &&function) noexcept {
+    for (auto &node : m_nodes) {
+      node.for_each_slab(function);
+    }
+  }
+
+  /// Returns the pages of free segments of all partitions to the kernel.
+  /// \return The number of bytes returned to the kernel.
+  inline std::size_t trim() noexcept {
+    std::size_t released = std::size_t();
+    for (auto &node : m_nodes) {
+      released += node.trim();
+    }
+    return released;
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments.
+   */
+  inline std::size_t used_segments() const noexcept {
+    std::size_t counter = std::size_t();
+    for (const auto &node : m_nodes) {
+      counter += node.used_segments();
+    }
+    return counter;
+  }
+
+  /// Adds the NUMA counters of this pool to \param stats.
+  inline void collect(exception_memory::NumaStatistics &stats) const noexcept {
+    for (const auto &counters : m_counters) {
+      stats.local_hits += counters.local_hits.load(std::memory_order_relaxed);
+      stats.remote_hits += counters.remote_hits.load(std::memory_order_relaxed);
+    }
+    stats.bound_nodes += m_bound_nodes;
+    stats.bind_failures += m_bind_failures;
+  }
+
+  /// Adds the used segments of the requested node to \param occupancy.
+  inline void collect(exception_memory::NumaNodeOccupancy &occupancy) const noexcept {
+    if (occupancy.node < Nodes) {
+      occupancy.used_segments += m_nodes[occupancy.node].used_segments();
+    }
+  }
+
+  /// Adds the counters of the segment allocators of all partitions to \param stats.
+  template <typename Statistics>
+  inline void collect(Statistics &stats) const noexcept {
+    for (const auto &node : m_nodes) {
+      node.collect(stats);
+    }
+  }
+
+  private:
+  /// Counters of the threads running on one node. Each lives on its own cache line.
+  struct alignas(64) Counters {
+    Counter<Policies::statistics> local_hits{0};
+    Counter<Policies::statistics> remote_hits{0};
+  };
+
+  std::array<NodePool, Nodes> m_nodes;
+  std::array<Counters, Nodes> m_counters;
+  std::size_t m_bound_nodes = 0;
+  std::size_t m_bind_failures = 0;
+};
+
+#ifdef EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY
+/** \return The value of the environment variable \param name or \param fallback if it is not set
+ *  or not a number.
+ */
+inline std::size_t environment_value(const char *name, const std::size_t fallback) noexcept {
+  const auto value = getenv(name);
+  if (value == nullptr || *value == '\0') {
+    return fallback;
+  }
+  char *end = nullptr;
+  const auto number = strtoull(value, &end, 10);
+  return *end == '\0' ? static_cast<std::size_t>(number) : fallback;
+}
+
+/** Segment pool whose geometry is chosen at runtime. The geometry is read from the environment
+ *  on construction and can be replaced with configure() as long as no segment is in use. Mapping
+ *  a pointer to its segment multiplies with a precomputed reciprocal of the segment size instead
+ *  of dividing by it.
+ */
+class RuntimeSegmentPool {
+  public:
+  inline RuntimeSegmentPool() noexcept {
+    exception_memory::PoolGeometry geometry{
+      environment_value("EXCEPTION_MEMORY_SEGMENT_SIZE", EXCEPTION_MEMORY__CXX_SIZE_CLASS_SIZES),
+      environment_value("EXCEPTION_MEMORY_SEGMENTS", EXCEPTION_MEMORY__CXX_SIZE_CLASS_COUNTS),
+      environment_value("EXCEPTION_MEMORY_ALIGNMENT", EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT)};
+    if (!valid(geometry)) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cerr << "Invalid exception memory pool geometry in the environment. Using the " <<
+        "compile time geometry." << std::endl;
+#endif
+      geometry = {EXCEPTION_MEMORY__CXX_SIZE_CLASS_SIZES, EXCEPTION_MEMORY__CXX_SIZE_CLASS_COUNTS,
+                  EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT};
+    }
+    build(geometry);
+  }
+
+  RuntimeSegmentPool( const RuntimeSegmentPool& ) = delete;
+  RuntimeSegmentPool& operator=( const RuntimeSegmentPool& ) = delete;
+
+  /** Replaces the geometry of the pool with \param geometry. Must not be called while other
+   *  threads throw.
+   *  \return false if the geometry is invalid or segments are in use.
+   */
+  inline bool configure(const exception_memory::PoolGeometry &geometry) noexcept {
+    if (!valid(geometry) || m_segments->used() != 0) {
+      return false;
+    }
+    m_segments.reset();
+    m_slab.reset();
+    build(geometry);
+    return true;
+  }
+
+  /// \return A free segment which is now marked as used or nullptr if all are in use.
+  inline void *allocate() noexcept {
+    const auto idx = m_segments->acquire();
+    if (idx == size) {
+      return nullptr;
+    }
+    if (!m_slab->commit(idx * segment_size, segment_size)) {
+      m_segments->release(idx);
+      return nullptr;
+    }
+    m_usage.allocated();
+    return m_slab->data() + idx * segment_size;
+  }
+
+  /// Marks the segment \param ptr as free again. \return false if \param ptr is no segment of
+  /// this pool.
+  inline bool deallocate(void *ptr) noexcept {
+    const auto idx = segment_idx(ptr);
+    if (idx == size) {
+      return false;
+    }
+    m_usage.freed();
+    m_segments->release(idx);
+    return true;
+  }
+
+  /// \returns if \param ptr is the start of a segment of this pool.
+  inline bool owns(const void *ptr) const noexcept {
+    return segment_idx(ptr) != size;
+  }
+
+  /// Calls \param function with the slab of this pool.
+  template <typename Function>
+  inline void for_each_slab(Function &&function) noexcept {
+    function(*m_slab);
+  }
+
+  /** Returns the pages of free segments to the kernel, see SegmentPool::trim().
+   *  \return The number of bytes returned to the kernel.
+   */
+  inline std::size_t trim() noexcept {
+    if (!m_trim.try_begin()) {
+      return 0;
+    }
+    const auto released = trim_segments(*m_segments, *m_slab, m_usage, size, segment_size,
+                                        m_high_water);
+    m_trim.end();
+    return released;
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments.
+   */
+  inline std::size_t used_segments() const noexcept {
+    return m_segments->used();
+  }
+
+  /// Adds the backing of the slab to \param stats.
+  inline void collect(exception_memory::BackingStatistics &stats) const noexcept {
+    m_slab->collect(stats);
+  }
+
+  /// Adds the reserved and committed bytes of the slab to \param stats.
+  inline void collect(exception_memory::CommitStatistics &stats) const noexcept {
+    m_slab->collect(stats);
+  }
+
+  /// This pool has no other counters.
+  template <typename Statistics>
+  inline void collect(Statistics &) const noexcept {}
+
+  // The geometry, named like the constants of SegmentPool.
+  std::size_t size = 0;
+  std::size_t max_size = 0;
+  std::size_t alignment = 0;
+  std::size_t segment_size = 0;
+
+  private:
+  /// The size of the slab is only known at runtime, so static storage falls back to the heap.
+  using Backing = std::conditional_t<std::is_same_v<DefaultBacking, StaticBacking>, HeapBacking,
+                                     DefaultBacking>;
+
+  std::optional<Slab<Backing>> m_slab;
+  std::optional<RuntimeProbingSegmentAllocator> m_segments;
+  /// ceil(2^64 / segment_size), divides offsets below 2^32 by the segment size.
+  std::uint64_t m_reciprocal = 0;
+  SegmentUsage m_usage;
+  TrimGate m_trim;
+  /// High-water mark of trim(), only accessed by the thread which started a trim at m_trim.
+  std::size_t m_high_water = 0;
+
+  /// \return if the pool can be built with \param geometry.
+  static bool valid(const exception_memory::PoolGeometry &geometry) noexcept {
+    const auto alignment = std::max(geometry.alignment, object_alignment);
+    if (geometry.segment_size <= object_offset || geometry.segments == 0 ||
+        (alignment & (alignment - 1)) != 0 || alignment > EXCEPTION_MEMORY__CXX_CACHE_LINE_SIZE) {
+      return false;
+    }
+    // Segment offsets must fit into 32 bits for the reciprocal division.
+    const auto stride = segment_stride(geometry.segment_size, alignment);
+    return geometry.segments <= (std::uint64_t(1) << 32) / stride;
+  }
+
+  /// Allocates the slab and the bookkeeping for \param geometry.
+  void build(const exception_memory::PoolGeometry &geometry) noexcept {
+    size = geometry.segments;
+    max_size = geometry.segment_size;
+    alignment = std::max(geometry.alignment, object_alignment);
+    segment_size = segment_stride(max_size, alignment);
+    m_reciprocal = ~std::uint64_t() / segment_size + 1;
+    m_high_water = 0;
+    m_slab.emplace(segment_size * size, alignment);
+    m_segments.emplace(size);
+  }
+
+  /** \return The index of the segment starting at \param ptr or size if \param ptr is not the
+   *  start of a segment of this pool.
+   */
+  std::size_t segment_idx(const void *ptr) const noexcept {
+    // Pointers below the slab wrap around and fail the range check as well.
+    const auto offset = reinterpret_cast<std::uintptr_t>(ptr) -
+        reinterpret_cast<std::uintptr_t>(m_slab->data());
+    if (offset >= segment_size * size) {
+      return size;
+    }
+    const auto idx = static_cast<std::size_t>(
+        (static_cast<unsigned __int128>(m_reciprocal) * offset) >> 64);
+    return idx * segment_size == offset ? idx : size;
+  }
+};
+
+#endif
+
+#if EXCEPTION_MEMORY__CXX_NUMA_NODES > 0
+template <std::size_t SegmentSize, std::size_t Size, typename Policies>
+using ExceptionSegmentPool = NumaSegmentPool<SegmentSize, Size, EXCEPTION_MEMORY__CXX_NUMA_NODES,
+                                             Policies>;
+#else
+template <std::size_t SegmentSize, std::size_t Size, typename Policies>
+using ExceptionSegmentPool = SegmentPool<SegmentSize, Size, Policies>;
+#endif
+
+/// \return if the elements of \param values are strictly ascending.
+template <std::size_t N>
+constexpr bool is_ascending(const std::size_t (&values)[N]) noexcept {
+  for (std::size_t i = 1; i < N; ++i) {
+    if (values[i - 1] >= values[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// \return The base 2 logarithm of \param value, rounded up.
+constexpr std::size_t ceil_log2(const std::size_t value) noexcept {
+  std::size_t log = 0;
+  while ((std::size_t(1) << log) < value) {
+    ++log;
+  }
+  return log;
+}
+
+/** Arena for exceptions too large for the size classes, managed by a buddy allocator. A block
+ *  of order o spans BlockSize << o bytes, allocations are rounded up to the next order and split
+ *  off larger free blocks, freed blocks merge with their free buddy. The free blocks of every
+ *  order are kept in a bitmap and the order of every allocated block in a byte per smallest
+ *  block, so freeing and ownership checks are O(1) in the number of blocks. Large exceptions
+ *  are rare, so the bookkeeping is guarded by a FutexLock, which spins briefly and then sleeps,
+ *  instead of being lock-free.
+ *  \tparam Policies Memory backing of the arena, see PoolPolicies.
+ *  \tparam ArenaSize Size of the arena in bytes.
+ *  \tparam BlockSize Size of the smallest block in bytes.
+ */
+template <typename Policies, std::size_t ArenaSize, std::size_t BlockSize>
+class LargeExceptionArena {
+  static_assert((ArenaSize & (ArenaSize - 1)) == 0 && (BlockSize & (BlockSize - 1)) == 0,
+      "The arena size and the block size must be powers of two.");
+  static_assert(BlockSize <= ArenaSize, "The arena must hold at least one block.");
+
+  static constexpr std::size_t blocks = ArenaSize / BlockSize;
+  static constexpr std::size_t orders = ceil_log2(blocks) + 1;
+
+  /// \return The first bit of the free bitmap of the blocks of order \param order.
+  static constexpr std::size_t first_bit(const std::size_t order) noexcept {
+    std::size_t bit = std::size_t();
+    for (std::size_t o = 0; o < order; ++o) {
+      bit += blocks >> o;
+    }
+    return bit;
+  }
+
+  static constexpr std::size_t words = (first_bit(orders) + bitmap::bits - 1) / bitmap::bits;
+
+  public:
+  /// Largest allocation the arena can hold.
+  static constexpr std::size_t max_size = ArenaSize;
+  /// Alignment of every block.
+  static constexpr std::size_t alignment =
+      std::max<std::size_t>(EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT, object_alignment);
+
+  static_assert(BlockSize % alignment == 0, "Blocks must keep the exception objects aligned.");
+
+  constexpr LargeExceptionArena() noexcept : m_slab(ArenaSize, alignment) {}
+
+  LargeExceptionArena( const LargeExceptionArena& ) = delete;
+  LargeExceptionArena& operator=( const LargeExceptionArena& ) = delete;
+
+  /// \return A free block of at least \param size bytes, now marked as used, or nullptr.
+  inline void *allocate(const std::size_t size) noexcept {
+    const auto order = ceil_log2((size + BlockSize - 1) / BlockSize);
+    if (order >= orders) {
+      m_failures.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    m_lock.lock();
+    if (!m_initialized) {
+      set_free(orders - 1, 0, true);
+      m_initialized = true;
+    }
+    auto o = order;
+    auto idx = blocks;
+    for (;;) {
+      for (o = order; o < orders; ++o) {
+        idx = find_free(o);
+        if (idx != blocks) {
+          break;
+        }
+      }
+      if (idx != blocks) {
+        break;
+      }
+      m_lock.unlock();
+      // A running trim holds the free blocks, wait for it to give them back.
+      if (!m_trim.wait()) {
+        m_failures.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      m_lock.lock();
+    }
+    set_free(o, idx, false);
+    // Split the block, keeping the lower half and freeing the upper one.
+    for (; o > order; --o) {
+      idx *= 2;
+      set_free(o - 1, idx + 1, true);
+    }
+    const auto first = idx << order;
+    m_orders[first] = static_cast<std::uint8_t>(order + 1);
+    m_used_bytes += BlockSize << order;
+    m_lock.unlock();
+    if (!m_slab.commit(first * BlockSize, BlockSize << order)) {
+      deallocate(m_slab.data() + first * BlockSize);
+      m_failures.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+    return m_slab.data() + first * BlockSize;
+  }
+
+  /// Frees the block \param ptr. \return false if \param ptr is no allocated block of this arena.
+  inline bool deallocate(void *ptr) noexcept {
+    // Pointers below the arena wrap around and fail the range check as well.
+    const auto offset = reinterpret_cast<std::uintptr_t>(ptr) -
+        reinterpret_cast<std::uintptr_t>(m_slab.data());
+    if (offset >= ArenaSize || offset % BlockSize != 0) {
+      return false;
+    }
+    const auto first = offset / BlockSize;
+    m_lock.lock();
+    if (m_orders[first] == 0) {
+      m_lock.unlock();
+      return false;
+    }
+    const auto order = std::size_t(m_orders[first] - 1);
+    m_orders[first] = 0;
+    m_used_bytes -= BlockSize << order;
+    free_block(order, first >> order);
+    m_lock.unlock();
+    return true;
+  }
+
+  /// Calls \param function with the slab of the arena.
+  template <typename Function>
+  inline void for_each_slab(Function &&function) noexcept {
+    function(m_slab);
+  }
+
+  /** Returns the pages of all free blocks to the kernel. The free blocks are held while their
+   *  pages are released without holding the lock, and freed again one by one. Large allocations
+   *  finding no free block meanwhile wait for them. Returns immediately if another thread trims
+   *  the arena.
+   *  \return The number of bytes returned to the kernel.
+   */
+  inline std::size_t trim() noexcept {
+    if (!m_trim.try_begin()) {
+      return 0;
+    }
+    m_lock.lock();
+    m_held = m_free;
+    m_free = {};
+    m_lock.unlock();
+    std::size_t released = std::size_t();
+    for (std::size_t order = 0; order < orders; ++order) {
+      for (std::size_t idx = 0; idx < (blocks >> order); ++idx) {
+        const auto bit = first_bit(order) + idx;
+        if ((m_held[bit / bitmap::bits] >> (bit % bitmap::bits) & 1) == 0) {
+          continue;
+        }
+        released += m_slab.trim((idx << order) * BlockSize, BlockSize << order);
+        m_held[bit / bitmap::bits] &= ~(std::uint64_t(1) << (bit % bitmap::bits));
+        m_lock.lock();
+        free_block(order, idx);
+        m_lock.unlock();
+        m_trim.progress();
+      }
+    }
+    m_trim.end();
+    return released;
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of allocated blocks.
+   */
+  inline std::size_t used_segments() const noexcept {
+    return static_cast<std::size_t>(std::count_if(m_orders.begin(), m_orders.end(),
+        [](const std::uint8_t order) { return order != 0; }));
+  }
+
+  /// Adds the occupancy and the counters of the arena to \param stats.
+  inline void collect(exception_memory::LargeExceptionStatistics &stats) const noexcept {
+    stats.arena_bytes += ArenaSize;
+    stats.used_bytes += m_used_bytes;
+    stats.allocations += m_allocations.load(std::memory_order_relaxed);
+    stats.failures += m_failures.load(std::memory_order_relaxed);
+  }
+
+  /// Adds the backing of the slab to \param stats.
+  inline void collect(exception_memory::BackingStatistics &stats) const noexcept {
+    m_slab.collect(stats);
+  }
+
+  /// Adds the reserved and committed bytes of the slab to \param stats.
+  inline void collect(exception_memory::CommitStatistics &stats) const noexcept {
+    m_slab.collect(stats);
+  }
+
+  /// The arena has no further counters.
+  template <typename Statistics>
+  inline void collect(Statistics &) const noexcept {}
+
+  private:
+  typename Policies::Backing::template SlabType<ArenaSize, alignment> m_slab;
+  FutexLock m_lock;
+  TrimGate m_trim;
+  /// Free blocks held by trim(), only accessed by the thread which started a trim at m_trim.
+  std::array<std::uint64_t, words> m_held{};
+  /// The following members are guarded by m_lock. The whole arena becomes a free block of the
+  /// highest order on first use, so the arena starts out zeroed.
+  bool m_initialized = false;
+  std::array<std::uint64_t, words> m_free{};
+  /// Order + 1 of the allocated block starting at every smallest block, 0 if none starts there.
+  std::array<std::uint8_t, blocks> m_orders{};
+  std::size_t m_used_bytes = 0;
+  Counter<Policies::statistics> m_allocations{0};
+  Counter<Policies::statistics> m_failures{0};
+
+  /// Frees the block \param idx of order \param order and merges it with its buddy as long as
+  /// that is free. Called with m_lock held.
+  void free_block(std::size_t order, std::size_t idx) noexcept {
+    for (; order + 1 < orders && is_free(order, idx ^ 1); ++order) {
+      set_free(order, idx ^ 1, false);
+      idx /= 2;
+    }
+    set_free(order, idx, true);
+  }
+
+  /// \return if the block \param idx of order \param order is free.
+  bool is_free(const std::size_t order, const std::size_t idx) const noexcept {
+    const auto bit = first_bit(order) + idx;
+    return (m_free[bit / bitmap::bits] >> (bit % bitmap::bits)) & 1;
+  }
+
+  /// Marks the block \param idx of order \param order as \param free.
+  void set_free(const std::size_t order, const std::size_t idx, const bool free) noexcept {
+    const auto bit = first_bit(order) + idx;
+    const auto mask = std::uint64_t(1) << (bit % bitmap::bits);
+    m_free[bit / bitmap::bits] = free ? m_free[bit / bitmap::bits] | mask :
+        m_free[bit / bitmap::bits] & ~mask;
+  }
+
+  /// \return The index of the first free block of order \param order or blocks if none is free.
+  std::size_t find_free(const std::size_t order) const noexcept {
+    const auto begin = first_bit(order);
+    const auto end = begin + (blocks >> order);
+    for (auto bit = begin; bit < end; bit = (bit / bitmap::bits + 1) * bitmap::bits) {
+      const auto word = m_free[bit / bitmap::bits] >> (bit % bitmap::bits);
+      if (word != 0) {
+        const auto found = bit + __builtin_ctzll(word);
+        return found < end ? found - begin : blocks;
+      }
+    }
+    return blocks;
+  }
+};
+
+/// Stand-in for a disabled large exception arena, all operations compile to nothing.
+struct NoLargeExceptionArena {
+  constexpr void *allocate(std::size_t) noexcept {
+    return nullptr;
+  }
+  constexpr bool deallocate(void *) noexcept {
+    return false;
+  }
+  template <typename Function>
+  constexpr void for_each_slab(Function &&) noexcept {}
+  constexpr std::size_t trim() noexcept {
+    return 0;
+  }
+  constexpr std::size_t used_segments() const noexcept {
+    return 0;
+  }
+  template <typename Statistics>
+  constexpr void collect(Statistics &) const noexcept {}
+};
+
+/** Chain of fallback tiers serving the allocations the memory pool cannot serve, see
+ *  exception_memory::set_fallback_chain(). Blocks of the overflow pool are recognised by their
+ *  address, every other block carries a header right before it naming its tier and ending in a
+ *  check word derived from the chain and the block address. Blocks are placed so that their
+ *  header never crosses into the previous page, so a free only reads the header of a pointer when
+ *  it is in the page of the pointer and thus mapped. Frees are routed in O(1) without a lock.
+ *  \tparam Policies Policies of the overflow pool.
+ *  \tparam SegmentSize Segment size of the overflow pool.
+ */
+template <typename Policies, std::size_t SegmentSize>
+class FallbackChain {
+  using Tier = exception_memory::FallbackTier;
+  static constexpr bool has_overflow_pool = EXCEPTION_MEMORY__CXX_OVERFLOW_POOL_SIZE > 0;
+
+  public:
+  /// Alignment of every block, the one of the segments of the memory pool.
+  static constexpr std::size_t alignment =
+      std::max<std::size_t>(EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT, object_alignment);
+
+  constexpr FallbackChain() noexcept = default;
+
+  FallbackChain( const FallbackChain& ) = delete;
+  FallbackChain& operator=( const FallbackChain& ) = delete;
+
+  /** Replaces the tiers with the \param count tiers in \param tiers with a single store.
+   *  \return false if a tier is unavailable, follows the libstdcxx tier or there are too many.
+   */
+  inline bool set_tiers(const Tier *tiers, const std::size_t count) noexcept {
+    if (count > exception_memory::max_fallback_tiers) {
+      return false;
+    }
+    std::uint32_t chain = static_cast<std::uint32_t>(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      // libstdc++ terminates instead of failing, the tiers after it are never reached.
+      if ((i > 0 && tiers[i - 1] == Tier::libstdcxx) ||
+          (tiers[i] == Tier::overflow_pool && !has_overflow_pool) ||
+          (tiers[i] == Tier::libstdcxx && !resolve_libstdcxx()) ||
+          static_cast<std::size_t>(tiers[i]) >= tier_count) {
+        return false;
+      }
+      chain |= static_cast<std::uint32_t>(tiers[i]) << (8 * (i + 1));
+    }
+    m_chain.store(chain, std::memory_order_release);
+    return true;
+  }
+
+  /// Sets the memory resource of the memory resource tier, nullptr disables the tier.
+  inline void set_memory_resource(std::pmr::memory_resource *resource) noexcept {
+    m_resource.store(resource, std::memory_order_release);
+  }
+
+  /// \return \param size bytes from the first tier which can serve them or nullptr.
+  inline void *allocate(const std::size_t size) noexcept {
+    const auto chain = m_chain.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < (chain & 0xff); ++i) {
+      const auto tier = static_cast<Tier>((chain >> (8 * (i + 1))) & 0xff);
+      const auto ret = allocate_from(tier, size);
+      if (ret != nullptr) {
+        m_hits[static_cast<std::size_t>(tier)].fetch_add(1, std::memory_order_relaxed);
+        return ret;
+      }
+    }
+    m_failures.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  /// Returns \param ptr to its tier. \return false if \param ptr was not allocated by a tier.
+  inline bool deallocate(void *ptr) noexcept {
+    if constexpr (has_overflow_pool) {
+      if (m_overflow.deallocate(ptr)) {
+        return true;
+      }
+    }
+    if (m_blocks.load(std::memory_order_relaxed) == 0) {
+      return false;
+    }
+    // Blocks never start in the first bytes of a page, the header of any other pointer may be
+    // on an unmapped page and is not read.
+    const auto address = reinterpret_cast<std::uintptr_t>(ptr);
+    if (address % alignment != 0 || address % header_page < sizeof (BlockHeader)) {
+      return false;
+    }
+    const auto header = reinterpret_cast<BlockHeader *>(ptr) - 1;
+    if (header->check != check(ptr)) {
+      return false;
+    }
+    header->check = 0;
+    m_blocks.fetch_sub(1, std::memory_order_relaxed);
+    if (header->tier == Tier::libstdcxx) {
+      m_cxa_free.load(std::memory_order_relaxed)(header->block);
+    }
+    else {
+      header->resource->deallocate(header->block, header->bytes, alignof (std::max_align_t));
+    }
+    return true;
+  }
+
+  /// Calls \param function with the slabs of the overflow pool.
+  template <typename Function>
+  inline void for_each_slab(Function &&function) noexcept {
+    if constexpr (has_overflow_pool) {
+      m_overflow.for_each_slab(function);
+    }
+  }
+
+  /// Returns the pages of free segments of the overflow pool to the kernel.
+  /// \return The number of bytes returned to the kernel.
+  inline std::size_t trim() noexcept {
+    if constexpr (has_overflow_pool) {
+      return m_overflow.trim();
+    }
+    return 0;
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments of the overflow pool.
+   */
+  inline std::size_t used_segments() const noexcept {
+    if constexpr (has_overflow_pool) {
+      return m_overflow.used_segments();
+    }
+    return 0;
+  }
+
+  /// Adds the tier hits to \param stats.
+  inline void collect(exception_memory::FallbackStatistics &stats) const noexcept {
+    stats.overflow_pool_hits +=
+        m_hits[static_cast<std::size_t>(Tier::overflow_pool)].load(std::memory_order_relaxed);
+    stats.libstdcxx_hits +=
+        m_hits[static_cast<std::size_t>(Tier::libstdcxx)].load(std::memory_order_relaxed);
+    stats.memory_resource_hits +=
+        m_hits[static_cast<std::size_t>(Tier::memory_resource)].load(std::memory_order_relaxed);
+    stats.failures += m_failures.load(std::memory_order_relaxed);
+  }
+
+  /// Adds the counters of the overflow pool to \param stats.
+  template <typename Statistics>
+  inline void collect(Statistics &stats) const noexcept {
+    if constexpr (has_overflow_pool) {
+      m_overflow.collect(stats);
+    }
+  }
+
+  private:
+  static constexpr std::size_t tier_count = exception_memory::max_fallback_tiers;
+
+  /// Header right before every block not allocated from the overflow pool.
+  struct BlockHeader {
+    /// Start of the allocation of the tier.
+    void *block;
+    /// Resource the block was allocated from, for the memory resource tier.
+    std::pmr::memory_resource *resource;
+    /// Size of the allocation of the tier.
+    std::size_t bytes;
+    Tier tier;
+    /// check() of the block, cleared when the block is freed.
+    std::uintptr_t check;
+  };
+
+  /// Smallest page size, a header never spans two blocks of this size.
+  static constexpr std::size_t header_page = 4096;
+  /// Header size rounded up to the alignment, a block is moved by it off the start of a page.
+  static constexpr std::size_t header_room =
+      (sizeof (BlockHeader) + alignment - 1) / alignment * alignment;
+  static_assert(header_room * 2 <= header_page, "Headers must fit into the page of a block.");
+
+  struct Empty {
+    constexpr Empty() noexcept = default;
+  };
+  using OverflowPool = std::conditional_t<has_overflow_pool,
+      ExceptionSegmentPool<SegmentSize, std::max(EXCEPTION_MEMORY__CXX_OVERFLOW_POOL_SIZE, 1),
+                           Policies>, Empty>;
+
+  /// Tier count in the lowest byte, followed by one byte per tier.
+  std::atomic<std::uint32_t> m_chain{0};
+  std::atomic<std::pmr::memory_resource *> m_resource{nullptr};
+  std::atomic<void *(*)(std::size_t)> m_cxa_allocate{nullptr};
+  std::atomic<void (*)(void *)> m_cxa_free{nullptr};
+  /// Number of live blocks with a header, frees skip the header check while there are none.
+  std::atomic<std::size_t> m_blocks{0};
+  std::array<Counter<Policies::statistics>, tier_count> m_hits{};
+  Counter<Policies::statistics> m_failures{0};
+  OverflowPool m_overflow;
+
+  /// \return The check word of the header of the block \param ptr of this chain.
+  std::uintptr_t check(const void *ptr) const noexcept {
+    return reinterpret_cast<std::uintptr_t>(this) ^ reinterpret_cast<std::uintptr_t>(ptr) ^
+        std::uintptr_t(0x9E3779B97F4A7C15ull);
+  }
+
+  /// \return \param size bytes from \param tier or nullptr.
+  void *allocate_from(const Tier tier, const std::size_t size) noexcept {
+    // Room for the header, for aligning the block and for moving it off the start of a page.
+    const auto bytes = size + sizeof (BlockHeader) + alignment - 1 + header_room;
+    switch (tier) {
+      case Tier::overflow_pool:
+        if constexpr (has_overflow_pool) {
+          if (size <= OverflowPool::max_size) {
+            return m_overflow.allocate();
+          }
+        }
+        return nullptr;
+      case Tier::libstdcxx:
+        return wrap(m_cxa_allocate.load(std::memory_order_relaxed)(bytes), tier, nullptr, bytes);
+      case Tier::memory_resource: {
+        // An exception thrown by the resource is allocated here as well, skip the resource
+        // then instead of recursing.
+        static thread_local bool in_resource = false;
+        const auto resource = m_resource.load(std::memory_order_acquire);
+        if (resource == nullptr || in_resource) {
+          return nullptr;
+        }
+        in_resource = true;
+        void *block = nullptr;
+        try {
+          block = resource->allocate(bytes, alignof (std::max_align_t));
+        } catch (...) {
+        }
+        in_resource = false;
+        return wrap(block, tier, resource, bytes);
+      }
+    }
+    return nullptr;
+  }
+
+  /// \return The aligned start of a block in \param block, preceded by its header.
+  void *wrap(void *block, const Tier tier, std::pmr::memory_resource *resource,
+             const std::size_t bytes) noexcept {
+    if (block == nullptr) {
+      return nullptr;
+    }
+    const auto begin = reinterpret_cast<std::uintptr_t>(block) + sizeof (BlockHeader);
+    auto ret = reinterpret_cast<char *>((begin + alignment - 1) / alignment * alignment);
+    if (reinterpret_cast<std::uintptr_t>(ret) % header_page < sizeof (BlockHeader)) {
+      ret += header_room;
+    }
+    new (ret - sizeof (BlockHeader)) BlockHeader{block, resource, bytes, tier, check(ret)};
+    m_blocks.fetch_add(1, std::memory_order_relaxed);
+    return ret;
+  }
+
+  /// Looks up the exception allocation functions of libstdc++. \return if they were found.
+  bool resolve_libstdcxx() noexcept {
+    if (m_cxa_free.load(std::memory_order_acquire) != nullptr) {
+      return true;
+    }
+    const auto allocate = reinterpret_cast<void *(*)(std::size_t)>(
+        dlsym(RTLD_NEXT, "__cxa_allocate_exception"));
+    const auto free = reinterpret_cast<void (*)(void *)>(
+        dlsym(RTLD_NEXT, "__cxa_free_exception"));
+    // Finding the overrides of this library again would recurse forever.
+    if (allocate == nullptr || free == nullptr ||
+        allocate == &__cxxabiv1::__cxa_allocate_exception) {
+      return false;
+    }
+    m_cxa_allocate.store(allocate, std::memory_order_relaxed);
+    m_cxa_free.store(free, std::memory_order_release);
+    return true;
+  }
+};
+
+/** Elastic growth of the memory pool. Counts the segments in use and wakes a low priority helper
+ *  thread once their share of the capacity crosses Watermark percent. The helper thread maps a
+ *  prefaulted slab and publishes it in a fixed array, so allocations only load the published
+ *  slabs and claim a segment of them lock-free. The throwing thread never maps memory, takes a
+ *  lock or blocks, waking the helper thread is a single futex call. Slabs are never unmapped, so
+ *  a published slab stays valid until the process exits.
+ *  \tparam Policies Start index of the segment allocators of the slabs, see PoolPolicies.
+ *  \tparam SegmentSize Usable size of every segment.
+ *  \tparam SlabSegments Number of segments of every slab.
+ *  \tparam MaxSlabs Maximal number of slabs.
+ *  \tparam Watermark Percentage of used segments above which the helper thread adds a slab.
+ */
+template <typename Policies, std::size_t SegmentSize, std::size_t SlabSegments,
+          std::size_t MaxSlabs, std::size_t Watermark>
+class ElasticGrowth {
+  static_assert(Watermark > 0 && Watermark <= 100, "The watermark is a percentage.");
+  static_assert(SlabSegments > 0, "Slabs must not be empty.");
+  static_assert(sizeof (std::atomic<std::uint32_t>) == sizeof (std::uint32_t),
+      "The wake up flag is used as futex.");
+
+  public:
+  /// Largest allocation a segment can hold.
+  static constexpr std::size_t max_size = SegmentSize;
+  /// Alignment of every segment, the one of the segments of the memory pool.
+  static constexpr std::size_t alignment =
+      std::max<std::size_t>(EXCEPTION_MEMORY__CXX_POOL_ALIGNMENT, object_alignment);
+  /// Distance between two neighbouring segments in a slab.
+  static constexpr std::size_t segment_size = segment_stride(SegmentSize, alignment);
+
+  constexpr ElasticGrowth() noexcept = default;
+
+  ElasticGrowth( const ElasticGrowth& ) = delete;
+  ElasticGrowth& operator=( const ElasticGrowth& ) = delete;
+
+  /** Starts the helper thread with SCHED_IDLE priority. Allocations are only counted from now
+   *  on. \param capacity Number of segments of the memory pool without the added slabs.
+   *  \param used Number of segments of the memory pool in use.
+   *  \return false if the helper thread was started before or could not be started.
+   */
+  inline bool start(const std::size_t capacity, const std::size_t used) noexcept {
+    bool started = false;
+    if (!m_started.compare_exchange_strong(started, true)) {
+      return false;
+    }
+    m_used.store(static_cast<std::ptrdiff_t>(used));
+    m_capacity.store(capacity + m_count.load(std::memory_order_relaxed) * SlabSegments);
+    try {
+      std::thread helper([this]() {
+        run();
+      });
+      const sched_param param{};
+      pthread_setschedparam(helper.native_handle(), SCHED_IDLE, &param);
+      helper.detach();
+    } catch (...) {
+      m_capacity.store(0);
+      m_started.store(false);
+      return false;
+    }
+    return true;
+  }
+
+  /** Counts an allocation from the memory pool and wakes the helper thread if the used segments
+   *  cross the watermark. Nothing is counted before the helper thread is started. A wake up
+   *  lost to the relaxed ordering is caught up by the next allocation above the watermark.
+   */
+  inline void note_allocated() noexcept {
+    const auto capacity = m_capacity.load(std::memory_order_relaxed);
+    if (capacity == 0) {
+      return;
+    }
+    const auto used = m_used.fetch_add(1, std::memory_order_relaxed) + 1;
+    // The flag stays set while the helper thread is awake, so only the first allocation above
+    // the watermark makes the system call.
+    if (used * 100 > static_cast<std::ptrdiff_t>(capacity * Watermark) &&
+        m_requested.load(std::memory_order_relaxed) == 0 &&
+        m_requested.exchange(1, std::memory_order_relaxed) == 0) {
+      m_requests.fetch_add(1, std::memory_order_relaxed);
+      syscall(SYS_futex, &m_requested, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+  }
+
+  /// Counts a free to the memory pool once the helper thread is started.
+  inline void note_freed() noexcept {
+    if (m_capacity.load(std::memory_order_relaxed) != 0) {
+      m_used.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// \return A free segment of the added slabs for \param size bytes or nullptr.
+  inline void *allocate(const std::size_t size) noexcept {
+    if (size > SegmentSize) {
+      return nullptr;
+    }
+    const auto count = m_count.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < count; ++i) {
+      const auto slab = m_slabs[i].load(std::memory_order_relaxed);
+      const auto idx = slab->segments.acquire();
+      if (idx != SlabSegments) {
+        m_allocations.fetch_add(1, std::memory_order_relaxed);
+        note_allocated();
+        return slab->data + idx * segment_size;
+      }
+    }
+    return nullptr;
+  }
+
+  /// Marks the segment \param ptr as free again. \return false if \param ptr is no segment of
+  /// an added slab.
+  inline bool deallocate(void *ptr) noexcept {
+    const auto count = m_count.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < count; ++i) {
+      const auto slab = m_slabs[i].load(std::memory_order_relaxed);
+      // Pointers below the slab wrap around and fail the range check as well.
+      const auto offset = reinterpret_cast<std::uintptr_t>(ptr) -
+          reinterpret_cast<std::uintptr_t>(slab->data);
+      if (offset < segment_size * SlabSegments && offset % segment_size == 0) {
+        slab->segments.release(offset / segment_size);
+        note_freed();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Calls \param function with every added slab. Slabs added later are locked in RAM once
+   *  lock_added_slabs() was called.
+   */
+  template <typename Function>
+  inline void for_each_slab(Function &&function) noexcept {
+    const auto count = m_count.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < count; ++i) {
+      function(*m_slabs[i].load(std::memory_order_relaxed));
+    }
+  }
+
+  /// Locks every slab added from now on in RAM, e.g. once the memory pool is locked.
+  inline void lock_added_slabs() noexcept {
+    m_lock_slabs.store(true);
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments of the added slabs.
+   */
+  inline std::size_t used_segments() const noexcept {
+    std::size_t used = std::size_t();
+    const auto count = m_count.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < count; ++i) {
+      used += m_slabs[i].load(std::memory_order_relaxed)->segments.used();
+    }
+    return used;
+  }
+
+  /// Adds the growth of the memory pool to \param stats.
+  inline void collect(exception_memory::ElasticStatistics &stats) const noexcept {
+    stats.slabs += m_count.load(std::memory_order_relaxed);
+    stats.capacity += m_capacity.load(std::memory_order_relaxed);
+    stats.used_segments += static_cast<std::size_t>(
+        std::max<std::ptrdiff_t>(m_used.load(std::memory_order_relaxed), 0));
+    stats.growth_requests += m_requests.load(std::memory_order_relaxed);
+    stats.growth_failures += m_failures.load(std::memory_order_relaxed);
+    stats.allocations += m_allocations.load(std::memory_order_relaxed);
+  }
+
+  /// Adds the mapped pages of the added slabs to \param stats.
+  inline void collect(exception_memory::BackingStatistics &stats) const noexcept {
+    stats.page_slabs += m_count.load(std::memory_order_relaxed);
+  }
+
+  /// Adds the reserved and committed bytes of the added slabs to \param stats.
+  inline void collect(exception_memory::CommitStatistics &stats) const noexcept {
+    const auto bytes = m_count.load(std::memory_order_relaxed) * sizeof (GrownSlab);
+    stats.reserved_bytes += bytes;
+    stats.committed_bytes += bytes;
+  }
+
+  /// The elastic growth has no further counters.
+  template <typename Statistics>
+  inline void collect(Statistics &) const noexcept {}
+
+  private:
+  /// Slab added by the helper thread, its bookkeeping followed by its segments.
+  struct GrownSlab {
+    ProbingSegmentAllocator<SlabSegments, typename Policies::StartIndex> segments;
+    alignas(alignment) char data[segment_size * SlabSegments];
+
+    std::size_t size() const noexcept {
+      return sizeof (GrownSlab);
+    }
+
+    /// The slab is mapped prefaulted and never trimmed. \return The size of the slab.
+    std::size_t prefault() const noexcept {
+      return size();
+    }
+
+    /// Locks the slab in RAM. \return 0 or the errno of the failed mlock call.
+    int lock() const noexcept {
+      return mlock(this, size()) == 0 ? 0 : errno;
+    }
+  };
+
+  std::array<std::atomic<GrownSlab *>, MaxSlabs> m_slabs{};
+  /// Number of published slabs, the slabs are published in order.
+  std::atomic<std::size_t> m_count{0};
+  /// Segments of the memory pool including the published slabs, 0 until the helper thread runs.
+  std::atomic<std::size_t> m_capacity{0};
+  /// Signed, frees of segments allocated before the start may be counted without allocation.
+  std::atomic<std::ptrdiff_t> m_used{0};
+  /// Futex the helper thread sleeps on while it is 0.
+  std::atomic<std::uint32_t> m_requested{0};
+  std::atomic<bool> m_started{false};
+  std::atomic<bool> m_lock_slabs{false};
+  Counter<Policies::statistics> m_requests{0};
+  Counter<Policies::statistics> m_failures{0};
+  Counter<Policies::statistics> m_allocations{0};
+
+  /// \return if the used segments are above the watermark.
+  bool above_watermark() const noexcept {
+    return m_used.load() * 100 > static_cast<std::ptrdiff_t>(m_capacity.load() * Watermark);
+  }
+
+  /// Loop of the helper thread, ends once all slabs are published.
+  void run() noexcept {
+    while (m_count.load(std::memory_order_relaxed) < MaxSlabs) {
+      if (above_watermark()) {
+        if (!grow()) {
+          // Let the system recover before the next attempt.
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        continue;
+      }
+      m_requested.store(0);
+      // Allocations crossing the watermark before the store see the cleared flag after it, so
+      // the wait returns immediately if one of them sets it again.
+      if (!above_watermark()) {
+        syscall(SYS_futex, &m_requested, FUTEX_WAIT_PRIVATE, 0, nullptr, nullptr, 0);
+      }
+    }
+    // No allocation needs to wake the helper thread anymore.
+    m_requested.store(1);
+  }
+
+  /// Maps, prefaults and publishes another slab. \return false if it could not be mapped.
+  bool grow() noexcept {
+    const auto mapping = mmap(nullptr, sizeof (GrownSlab), PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (mapping == MAP_FAILED) {
+      m_failures.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    const auto count = m_count.load(std::memory_order_relaxed);
+    const auto slab = new (mapping) GrownSlab;
+    m_slabs[count].store(slab, std::memory_order_relaxed);
+    m_count.store(count + 1);
+    // Either this sees the flag or lock_added_slabs() is followed by a for_each_slab() which
+    // sees the slab.
+    if (m_lock_slabs.load()) {
+      slab->lock();
+    }
+    m_capacity.fetch_add(SlabSegments);
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    std::cout << "Exception memory pool grown by " << SlabSegments << " segments." << std::endl;
+#endif
+    exception_memory_pool_grown(count + 1, m_capacity.load(std::memory_order_relaxed));
+    return true;
+  }
+};
+
+/// Stand-in for a disabled elastic growth, all operations compile to nothing.
+struct NoElasticGrowth {
+  constexpr bool start(std::size_t, std::size_t) noexcept {
+    return false;
+  }
+  template <typename Function>
+  constexpr void for_each_slab(Function &&) noexcept {}
+  constexpr void lock_added_slabs() noexcept {}
+  constexpr void note_allocated() noexcept {}
+  constexpr void note_freed() noexcept {}
+  constexpr void *allocate(std::size_t) noexcept {
+    return nullptr;
+  }
+  constexpr bool deallocate(void *) noexcept {
+    return false;
+  }
+  constexpr std::size_t used_segments() const noexcept {
+    return 0;
+  }
+  template <typename Statistics>
+  constexpr void collect(Statistics &) const noexcept {}
+};
+
+/** Lane of segments reserved for threads with a real-time scheduling policy, so bursts of
+ *  exceptions thrown by best-effort threads, e.g. logging threads, can neither exhaust the
+ *  segments of the real-time threads nor lengthen their probes. The policy of a thread is
+ *  detected at its first exception and cached in thread local storage.
+ *  \tparam Policies Policies of the lane pool, see PoolPolicies.
+ *  \tparam SegmentSize Segment size of the lane.
+ *  \tparam Size Number of segments of the lane.
+ */
+template <typename Policies, std::size_t SegmentSize, std::size_t Size>
+class RealTimeLane {
+  public:
+  /// Largest allocation the lane can hold.
+  static constexpr std::size_t max_size = SegmentSize;
+
+  /// Scheduling policy class of a thread.
+  enum class Scheduling : std::uint8_t {
+    unknown,
+    best_effort,
+    real_time
+  };
+
+  constexpr RealTimeLane() noexcept = default;
+
+  RealTimeLane( const RealTimeLane& ) = delete;
+  RealTimeLane& operator=( const RealTimeLane& ) = delete;
+
+  /// \return if the calling thread has a real-time scheduling policy.
+  inline bool real_time() noexcept {
+    auto scheduling = t_scheduling;
+    if (__builtin_expect(scheduling == Scheduling::unknown, false)) {
+      scheduling = detect();
+    }
+    return scheduling == Scheduling::real_time;
+  }
+
+  /// Detects the scheduling policy of the calling thread again, e.g. after it was changed.
+  inline Scheduling detect() noexcept {
+    // sched_getscheduler reports SCHED_RESET_ON_FORK as a flag of the policy.
+    const auto policy = sched_getscheduler(0) & ~reset_on_fork;
+    const auto scheduling = policy == SCHED_FIFO || policy == SCHED_RR || policy == sched_deadline ?
+        Scheduling::real_time : Scheduling::best_effort;
+    // A thread is counted once, even if it leaves and regains its real-time policy.
+    if (scheduling == Scheduling::real_time && !t_counted) {
+      t_counted = true;
+      m_threads.fetch_add(1, std::memory_order_relaxed);
+    }
+    t_scheduling = scheduling;
+    return scheduling;
+  }
+
+  /// \return A free segment of the lane or nullptr if the lane is exhausted.
+  inline void *allocate() noexcept {
+    const auto ret = m_pool.allocate();
+    if (ret != nullptr) {
+      m_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+  /// Counts an exception of a real-time thread served by the memory pool instead of the lane.
+  inline void note_spill() noexcept {
+    m_spills.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Marks the segment \param ptr as free again. \return false if the lane does not own \param ptr.
+  inline bool deallocate(void *ptr) noexcept {
+    return m_pool.deallocate(ptr);
+  }
+
+  /// \return The pool of the lane.
+  inline auto &pool() noexcept {
+    return m_pool;
+  }
+
+  /// Calls \param function with the slab of the lane.
+  template <typename Function>
+  inline void for_each_slab(Function &&function) noexcept {
+    m_pool.for_each_slab(function);
+  }
+
+  /// Returns the pages of free segments of the lane to the kernel.
+  /// \return The number of bytes returned to the kernel.
+  inline std::size_t trim() noexcept {
+    return m_pool.trim();
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments of the lane.
+   */
+  inline std::size_t used_segments() const noexcept {
+    return m_pool.used_segments();
+  }
+
+  /// Adds the occupancy and the counters of the lane to \param stats.
+  inline void collect(exception_memory::RealTimeLaneStatistics &stats) const noexcept {
+    stats.real_time_threads += m_threads.load(std::memory_order_relaxed);
+    stats.segments += Size;
+    stats.used_segments += m_pool.used_segments();
+    stats.lane_allocations += m_allocations.load(std::memory_order_relaxed);
+    stats.spilled_allocations += m_spills.load(std::memory_order_relaxed);
+  }
+
+  /// Adds the counters of type Statistics of the lane pool to \param stats.
+  template <typename Statistics>
+  inline void collect(Statistics &stats) const noexcept {
+    m_pool.collect(stats);
+  }
+
+  private:
+  /// SCHED_DEADLINE of linux/sched.h, which not every libc exports.
+  static constexpr int sched_deadline = 6;
+  /// SCHED_RESET_ON_FORK of linux/sched.h.
+  static constexpr int reset_on_fork = 0x40000000;
+
+  /// Scheduling policy of the calling thread, unknown until its first exception.
+  static inline thread_local Scheduling t_scheduling = Scheduling::unknown;
+  /// Set once the calling thread is counted as real-time thread.
+  static inline thread_local bool t_counted = false;
+
+  ExceptionSegmentPool<SegmentSize, Size, Policies> m_pool;
+  Counter<Policies::statistics> m_threads{0};
+  Counter<Policies::statistics> m_allocations{0};
+  Counter<Policies::statistics> m_spills{0};
+};
+
+/// Stand-in for RealTimeLane if it is disabled.
+struct NoRealTimeLane {
+  static constexpr std::size_t max_size = 0;
+  constexpr bool real_time() noexcept {
+    return false;
+  }
+  constexpr void detect() noexcept {}
+  constexpr void *allocate() noexcept {
+    return nullptr;
+  }
+  constexpr void note_spill() noexcept {}
+  constexpr bool deallocate(void *) noexcept {
+    return false;
+  }
+  template <typename Function>
+  constexpr void for_each_slab(Function &&) noexcept {}
+  constexpr std::size_t trim() noexcept {
+    return 0;
+  }
+  constexpr std::size_t used_segments() const noexcept {
+    return 0;
+  }
+  template <typename Statistics>
+  constexpr void collect(Statistics &) const noexcept {}
+};
+
+/** Named pool domains, separate segment pools isolating the exceptions of the threads bound to
+ *  them, e.g. of one subsystem, from the memory pool and from each other. The domains are sized
+ *  at compile time and named at runtime. A thread is bound to a domain through a thread local
+ *  binding, so routing an allocation is a single compare.
+ *  \tparam Policies Policies of the domain pools, see PoolPolicies.
+ *  \tparam SegmentSize Segment size of every domain.
+ *  \tparam Sizes Number of segments of every domain.
+ */
+template <typename Policies, std::size_t SegmentSize, std::size_t... Sizes>
+class PoolDomains {
+  static constexpr std::size_t count = sizeof...(Sizes);
+  static constexpr std::size_t sizes[] = {Sizes..., 0};
+
+  public:
+  /// Largest allocation a domain can hold.
+  static constexpr std::size_t max_size = SegmentSize;
+
+  constexpr PoolDomains() noexcept = default;
+
+  PoolDomains( const PoolDomains& ) = delete;
+  PoolDomains& operator=( const PoolDomains& ) = delete;
+
+  /// \return if the calling thread is bound to a domain.
+  inline bool bound() const noexcept {
+    if constexpr (count == 0) {
+      return false;
+    }
+    return t_binding.owner == this;
+  }
+
+  /// \return A free segment of the domain of the calling thread or nullptr if it is exhausted.
+  inline void *allocate() noexcept {
+    const auto domain = t_binding.domain;
+    void *ret = nullptr;
+    with_pool(static_cast<std::size_t>(domain - m_domains.data()), [&ret](auto &pool) {
+      ret = pool.allocate();
+    });
+    (ret != nullptr ? domain->allocations : domain->failures).fetch_add(
+        1, std::memory_order_relaxed);
+    return ret;
+  }
+
+  /// Marks the segment \param ptr as free again. \return false if no domain owns \param ptr.
+  inline bool deallocate(void *ptr) noexcept {
+    return std::apply([ptr](auto &... pool) {
+      return (false || ... || pool.deallocate(ptr));
+    }, m_pools);
+  }
+
+  /** \return The domain named \param name, named now if no domain has the name yet. A new name
+   *  is given to the smallest unnamed domain with at least \param segments segments.
+   *  exception_memory::invalid_domain if there is none or the named domain is too small.
+   */
+  inline exception_memory::DomainId open(const char *name, const std::size_t segments) noexcept {
+    if (name == nullptr || *name == '\0') {
+      return exception_memory::invalid_domain;
+    }
+    // Opening domains is rare, a spin lock keeps two threads from giving a name to two domains.
+    while (m_lock.test_and_set(std::memory_order_acquire)) {
+    }
+    auto best = find(name);
+    if (best != count) {
+      if (sizes[best] < segments) {
+        best = count;
+      }
+    }
+    else {
+      for (std::size_t i = 0; i < count; ++i) {
+        if (!m_domains[i].open.load(std::memory_order_relaxed) && sizes[i] >= segments &&
+            (best == count || sizes[i] < sizes[best])) {
+          best = i;
+        }
+      }
+      if (best != count) {
+        strncpy(m_domains[best].name, name, sizeof (m_domains[best].name) - 1);
+        m_domains[best].open.store(true, std::memory_order_release);
+      }
+    }
+    m_lock.clear(std::memory_order_release);
+    return best != count ? best + 1 : exception_memory::invalid_domain;
+  }
+
+  /// Binds the calling thread to \param domain. \return false if \param domain is not open.
+  inline bool bind(const exception_memory::DomainId domain) noexcept {
+    if (domain == exception_memory::default_domain) {
+      if (bound()) {
+        t_binding = Binding{};
+      }
+      return true;
+    }
+    if (domain > count || !m_domains[domain - 1].open.load(std::memory_order_acquire)) {
+      return false;
+    }
+    t_binding = Binding{this, &m_domains[domain - 1]};
+    return true;
+  }
+
+  /// \return The domain the calling thread is bound to.
+  inline exception_memory::DomainId current() const noexcept {
+    if (!bound()) {
+      return exception_memory::default_domain;
+    }
+    return static_cast<std::size_t>(t_binding.domain - m_domains.data()) + 1;
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The occupancy and the counters of \param domain, all values are 0 if it is not open.
+   */
+  inline exception_memory::DomainStatistics statistics(
+      const exception_memory::DomainId domain) noexcept {
+    exception_memory::DomainStatistics stats{};
+    if (domain == exception_memory::default_domain || domain > count ||
+        !m_domains[domain - 1].open.load(std::memory_order_acquire)) {
+      return stats;
+    }
+    const auto &info = m_domains[domain - 1];
+    stats.name = info.name;
+    stats.segments = sizes[domain - 1];
+    with_pool(domain - 1, [&stats](auto &pool) {
+      stats.used_segments = pool.used_segments();
+    });
+    stats.allocations = info.allocations.load(std::memory_order_relaxed);
+    stats.failures = info.failures.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  /// Calls \param function with the slabs of all domains.
+  template <typename Function>
+  inline void for_each_slab(Function &&function) noexcept {
+    std::apply([&function](auto &... pool) {
+      (pool.for_each_slab(function), ...);
+    }, m_pools);
+  }
+
+  /// Returns the pages of free segments of all domains to the kernel.
+  /// \return The number of bytes returned to the kernel.
+  inline std::size_t trim() noexcept {
+    return std::apply([](auto &... pool) {
+      return (std::size_t() + ... + pool.trim());
+    }, m_pools);
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments of all domains.
+   */
+  inline std::size_t used_segments() const noexcept {
+    return std::apply([](const auto &... pool) {
+      return (std::size_t() + ... + pool.used_segments());
+    }, m_pools);
+  }
+
+  /// Adds the counters of type Statistics of all domains to \param stats.
+  template <typename Statistics>
+  inline void collect(Statistics &stats) const noexcept {
+    std::apply([&stats](const auto &... pool) {
+      (pool.collect(stats), ...);
+    }, m_pools);
+  }
+
+  private:
+  /// Name and counters of one domain.
+  struct Domain {
+    /// Set once the domain is named, it keeps its name until the process exits.
+    std::atomic<bool> open{false};
+    char name[exception_memory::max_domain_name]{};
+    Counter<Policies::statistics> allocations{0};
+    Counter<Policies::statistics> failures{0};
+  };
+
+  /// Domain the calling thread is bound to and the instance owning it.
+  struct Binding {
+    const PoolDomains *owner = nullptr;
+    Domain *domain = nullptr;
+  };
+
+  /** Binding of the calling thread, empty for the memory pool itself. The thread local is shared
+   *  by every instance with the same parameters, e.g. of different shared objects, so a thread
+   *  is bound to a domain of one instance at a time and unbound in all others.
+   */
+  static inline thread_local Binding t_binding{};
+
+  std::tuple<ExceptionSegmentPool<SegmentSize, Sizes, Policies>...> m_pools;
+  std::array<Domain, count> m_domains{};
+  std::atomic_flag m_lock = ATOMIC_FLAG_INIT;
+
+  /// \return The index of the domain named \param name or count. Called with m_lock held.
+  std::size_t find(const char *name) const noexcept {
+    for (std::size_t i = 0; i < count; ++i) {
+      if (m_domains[i].open.load(std::memory_order_relaxed) &&
+          strncmp(m_domains[i].name, name, sizeof (m_domains[i].name) - 1) == 0) {
+        return i;
+      }
+    }
+    return count;
+  }
+
+  /// Calls \param function with the pool of the domain with index \param idx.
+  template <typename Function>
+  void with_pool(const std::size_t idx, Function &&function) noexcept {
+    with_pool(idx, function, std::index_sequence_for<decltype(Sizes)...>());
+  }
+
+  template <typename Function, std::size_t... I>
+  void with_pool(const std::size_t idx, Function &function, std::index_sequence<I...>) noexcept {
+    ((idx == I ? function(std::get<I>(m_pools)) : void()), ...);
+  }
+};
+
+/** Per thread quotas of the memory pool. Every thread owns a record holding its exceptions in
+ *  flight, its reservation and the segments backing it in a single word, so charging and
+ *  refunding an exception is a single atomic operation on a cache line of its own. Reserving
+ *  claims real segments of the largest size class into a stash of the record, which the thread
+ *  allocates from first, so neither other threads nor thread caches can take them. Every
+ *  exception is tagged with the record it is charged to, so it can be refunded by any thread,
+ *  also after its owner exited, and segments of the stash go back to it.
+ *  \tparam SegmentPool Largest size class of the memory pool, which backs the reservations.
+ *  \tparam Cap Maximal number of exceptions in flight of a thread beyond its reservation.
+ *  \tparam MaxThreads Number of records. Further threads share one record without cap.
+ *  \tparam EnableStatistics Whether the refused allocations are counted.
+ */
+template <typename SegmentPool, std::size_t Cap, std::size_t MaxThreads, bool EnableStatistics>
+class ThreadQuotas {
+  static constexpr std::uint64_t field_bits = 21;
+  static constexpr std::uint64_t field_mask = (std::uint64_t(1) << field_bits) - 1;
+  static constexpr std::uint64_t held_shift = field_bits;
+  static constexpr std::uint64_t reservation_shift = 2 * field_bits;
+  static constexpr std::uint64_t claimed = std::uint64_t(1) << 63;
+
+  static_assert(Cap <= field_mask, "The cap of a thread must fit into its record.");
+
+  public:
+  /// Quota of one thread. Each record lives on its own cache line.
+  struct alignas(64) Record {
+    ThreadQuotas *owner = nullptr;
+    /// Exceptions in flight in bits 0 to 20, the segments claimed for the reservation in bits 21
+    /// to 41, the reservation in bits 42 to 62 and if a thread owns the record in bit 63.
+    std::atomic<std::uint64_t> state{0};
+    /// Free claimed segments. Any thread pushes, only the owner pops, so it is free of ABA.
+    std::atomic<void *> stash{nullptr};
+  };
+
+  inline explicit ThreadQuotas(SegmentPool &pool) noexcept : m_pool(pool) {
+    // Keys below PTHREAD_KEY_2NDLEVEL_SIZE are stored without dynamic memory.
+    if (pthread_key_create(&m_key, &ThreadQuotas::release_record) != 0) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cerr << "Could not initalize exception memory thread quotas. Terminating." << std::endl;
+#endif
+      std::terminate();
+    }
+    m_shared.owner = this;
+  }
+
+  inline ~ThreadQuotas() noexcept {
+    pthread_key_delete(m_key);
+  }
+
+  ThreadQuotas( const ThreadQuotas& ) = delete;
+  ThreadQuotas& operator=( const ThreadQuotas& ) = delete;
+
+  /** Charges an exception to the quota of the calling thread. Threads sharing a record are not
+   *  counted, so they never write to a shared cache line.
+   *  \return The record the exception is charged to or nullptr if the thread reached its cap.
+   */
+  inline Record *charge() noexcept {
+    const auto record = thread_record();
+    if (record == &m_shared) {
+      return record;
+    }
+    auto state = record->state.load(std::memory_order_relaxed);
+    do {
+      if (in_flight(state) >= std::max<std::uint64_t>(Cap, reservation(state))) {
+        m_capped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+    } while (!record->state.compare_exchange_weak(state, state + 1, std::memory_order_relaxed));
+    return record;
+  }
+
+  /// \return A free segment of the stash of \param record, which the calling thread owns, or
+  /// nullptr if it is empty.
+  inline void *take_reserved(Record *record) noexcept {
+    if (record == &m_shared || record->stash.load(std::memory_order_relaxed) == nullptr) {
+      return nullptr;
+    }
+    return pop(*record);
+  }
+
+  /// Refunds an exception charged to \param record, nullptr if it was not charged.
+  inline void refund(Record *record) noexcept {
+    if (record == nullptr || record == &m_shared) {
+      return;
+    }
+    record->state.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /** Refunds the exception in the segment \param ptr of the stash of the record \param tag and
+   *  puts the segment back into the stash.
+   *  \return false if the reservation shrank meanwhile, the segment has to be released to the
+   *  memory pool then.
+   */
+  inline bool restash(Record *tag, void *ptr) noexcept {
+    const auto record = untagged(tag);
+    auto state = record->state.load(std::memory_order_relaxed);
+    bool surplus;
+    do {
+      surplus = held(state) > reservation(state);
+      // A surplus segment is no longer claimed for the reservation.
+      const auto next = state - 1 - (surplus ? std::uint64_t(1) << held_shift : 0);
+      if (record->state.compare_exchange_weak(state, next, std::memory_order_relaxed)) {
+        break;
+      }
+    } while (true);
+    if (!surplus) {
+      push(*record, ptr);
+    }
+    return !surplus;
+  }
+
+  /** Sets the reservation of the calling thread to \param segments. Growing it claims the missing
+   *  segments from the largest size class, shrinking it releases the free surplus segments.
+   *  \return false if the calling thread has no record of its own or the size class has not
+   *  enough free segments, the reservation is left unchanged then.
+   */
+  inline bool reserve(const std::size_t segments) noexcept {
+    const auto record = thread_record();
+    if (record == &m_shared || segments > field_mask) {
+      return false;
+    }
+    // Only the owning thread claims segments and changes its reservation, other threads only
+    // refund exceptions and give surplus segments back.
+    auto state = record->state.load(std::memory_order_relaxed);
+    const auto missing = segments > held(state) ? segments - held(state) : std::uint64_t();
+    for (std::uint64_t claimed_segments = 0; claimed_segments < missing; ++claimed_segments) {
+      const auto ptr = m_pool.allocate();
+      if (ptr == nullptr) {
+        for (; claimed_segments > 0; --claimed_segments) {
+          m_pool.deallocate(pop(*record));
+        }
+        m_refused.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      push(*record, ptr);
+    }
+    while (!record->state.compare_exchange_weak(
+        state, with_reservation(state + (missing << held_shift), segments),
+        std::memory_order_relaxed)) {
+    }
+    trim_stash(*record);
+    return true;
+  }
+
+  /// \return The reservation of the calling thread.
+  inline std::size_t reservation() noexcept {
+    return static_cast<std::size_t>(
+        reservation(thread_record()->state.load(std::memory_order_relaxed)));
+  }
+
+  /// \return if \param tag marks a segment of a stash.
+  static bool stashed(const Record *tag) noexcept {
+    return (reinterpret_cast<std::uintptr_t>(tag) & 1) != 0;
+  }
+
+  /// \return The tag of a segment of the stash of \param record.
+  static Record *stash_tag(Record *record) noexcept {
+    return reinterpret_cast<Record *>(reinterpret_cast<std::uintptr_t>(record) | 1);
+  }
+
+  /// Adds the owned records, the reservations and the refusals to \param stats.
+  inline void collect(exception_memory::QuotaStatistics &stats) const noexcept {
+    for (const auto &record : m_records) {
+      const auto state = record.state.load(std::memory_order_relaxed);
+      stats.tracked_threads += (state & claimed) != 0;
+      stats.reserved_segments += reservation(state);
+      stats.held_segments += held(state);
+    }
+    stats.cap_rejections += m_capped.load(std::memory_order_relaxed);
+    stats.reservation_rejections += m_refused.load(std::memory_order_relaxed);
+  }
+
+  /// The quotas have no further counters.
+  template <typename Statistics>
+  inline void collect(Statistics &) const noexcept {}
+
+  private:
+  /// Free segment of a stash.
+  struct StashNode {
+    StashNode *next;
+  };
+
+  SegmentPool &m_pool;
+  pthread_key_t m_key;
+  std::array<Record, MaxThreads> m_records;
+  /// Record of the threads which found no free record.
+  Record m_shared;
+  Counter<EnableStatistics> m_capped{0};
+  Counter<EnableStatistics> m_refused{0};
+
+  static std::uint64_t in_flight(const std::uint64_t state) noexcept {
+    return state & field_mask;
+  }
+
+  static std::uint64_t held(const std::uint64_t state) noexcept {
+    return (state >> held_shift) & field_mask;
+  }
+
+  static std::uint64_t reservation(const std::uint64_t state) noexcept {
+    return (state >> reservation_shift) & field_mask;
+  }
+
+  static std::uint64_t with_reservation(const std::uint64_t state,
+                                        const std::uint64_t segments) noexcept {
+    return (state & ~(field_mask << reservation_shift)) | (segments << reservation_shift);
+  }
+
+  static Record *untagged(Record *tag) noexcept {
+    return reinterpret_cast<Record *>(reinterpret_cast<std::uintptr_t>(tag) & ~std::uintptr_t(1));
+  }
+
+  static void push(Record &record, void *ptr) noexcept {
+    const auto node = static_cast<StashNode *>(ptr);
+    auto head = record.stash.load(std::memory_order_relaxed);
+    do {
+      node->next = static_cast<StashNode *>(head);
+    } while (!record.stash.compare_exchange_weak(head, node, std::memory_order_release,
+                                                 std::memory_order_relaxed));
+  }
+
+  /// Only called by the owner of \param record. \return A segment of the stash or nullptr.
+  static void *pop(Record &record) noexcept {
+    auto head = record.stash.load(std::memory_order_acquire);
+    while (head != nullptr && !record.stash.compare_exchange_weak(
+        head, static_cast<StashNode *>(head)->next, std::memory_order_acquire)) {
+    }
+    return head;
+  }
+
+  /** Releases the free segments of the stash of \param record beyond its reservation to the
+   *  size class. Only called by the owner of \param record. Segments in flight are released once
+   *  they are freed, a segment put back while the reservation shrinks stays in the stash until
+   *  the next call.
+   */
+  void trim_stash(Record &record) noexcept {
+    auto state = record.state.load(std::memory_order_relaxed);
+    while (held(state) > reservation(state)) {
+      const auto ptr = pop(record);
+      if (ptr == nullptr) {
+        return;
+      }
+      do {
+        if (held(state) <= reservation(state)) {
+          push(record, ptr);
+          return;
+        }
+      } while (!record.state.compare_exchange_weak(state, state - (std::uint64_t(1) << held_shift),
+                                                   std::memory_order_relaxed));
+      m_pool.deallocate(ptr);
+      state = record.state.load(std::memory_order_relaxed);
+    }
+  }
+
+  /// \return The record of the calling thread, m_shared if it does not own one.
+  Record *thread_record() noexcept {
+    auto record = static_cast<Record *>(pthread_getspecific(m_key));
+    if (record == nullptr) {
+      record = claim_record();
+    }
+    return record;
+  }
+
+  /// \return A record without owner, reservation and exceptions in flight or m_shared if there
+  /// is none.
+  Record *claim_record() noexcept {
+    auto record = &m_shared;
+    for (auto &elem : m_records) {
+      auto state = elem.state.load(std::memory_order_relaxed);
+      if ((state & claimed) == 0 && in_flight(state) == 0 && reservation(state) == 0 &&
+          elem.state.compare_exchange_strong(state, state | claimed, std::memory_order_acquire)) {
+        elem.owner = this;
+        // Segments put back after the previous owner exited.
+        trim_stash(elem);
+        record = &elem;
+        break;
+      }
+    }
+    pthread_setspecific(m_key, record);
+    return record;
+  }
+
+  /** Drops the reservation of the record \param vrecord once its thread exits and releases the
+   *  free segments of its stash. The record can be claimed again once the exceptions charged to
+   *  it are refunded.
+   */
+  static void release_record(void *vrecord) noexcept {
+    auto record = static_cast<Record *>(vrecord);
+    if (record == &record->owner->m_shared) {
+      return;
+    }
+    auto state = record->state.load(std::memory_order_relaxed);
+    while (!record->state.compare_exchange_weak(state, with_reservation(state, 0),
+                                                std::memory_order_relaxed)) {
+    }
+    record->owner->trim_stash(*record);
+    record->state.fetch_and(~claimed, std::memory_order_release);
+  }
+};
+
+/// Stand-in for disabled thread quotas, every exception is granted and nothing is counted.
+struct NoThreadQuotas {
+  using Record = void;
+
+  template <typename SegmentPool>
+  constexpr explicit NoThreadQuotas(SegmentPool &) noexcept {}
+
+  constexpr Record *charge() noexcept {
+    return this;
+  }
+  constexpr void *take_reserved(Record *) noexcept {
+    return nullptr;
+  }
+  constexpr void refund(Record *) noexcept {}
+  constexpr bool restash(Record *, void *) noexcept {
+    return false;
+  }
+  constexpr bool reserve(std::size_t) noexcept {
+    return false;
+  }
+  constexpr std::size_t reservation() noexcept {
+    return 0;
+  }
+  static constexpr bool stashed(const Record *) noexcept {
+    return false;
+  }
+  static constexpr Record *stash_tag(Record *record) noexcept {
+    return record;
+  }
+  template <typename Statistics>
+  constexpr void collect(Statistics &) const noexcept {}
+};
+
+/** Thread safe exception memory pool. The memory is split into size classes, each with its own
+ *  segment size and number of segments. An allocation is served by the smallest size class it
+ *  fits into, or by the next larger one if that class is exhausted.
+ *  \tparam Policies Segment allocator, memory backing and statistics, see PoolPolicies.
+ */
+template <typename Policies>
+class BasicExceptionMemoryPool {
+  public:
+  static constexpr std::size_t segment_sizes[] = {EXCEPTION_MEMORY__CXX_SIZE_CLASS_SIZES};
+  static constexpr std::size_t segment_counts[] = {EXCEPTION_MEMORY__CXX_SIZE_CLASS_COUNTS};
+  static constexpr std::size_t size_classes = std::size(segment_sizes);
+
+  static_assert(std::size(segment_counts) == size_classes,
+      "Every size class needs a segment size and a segment count.");
+  static_assert(is_ascending(segment_sizes), "Size classes must be sorted by segment size.");
+#ifdef EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY
+  static_assert(size_classes == 1, "The runtime geometry supports a single size class only.");
+#endif
+
+#ifdef EXCEPTION_MEMORY__CXX_PREFAULT_AND_LOCK
+  inline BasicExceptionMemoryPool() noexcept : m_startup_prefault(prefault_and_lock()) {}
+#else
+  constexpr BasicExceptionMemoryPool() noexcept = default;
+#endif
+
+  BasicExceptionMemoryPool( const BasicExceptionMemoryPool& ) = delete;
+  BasicExceptionMemoryPool& operator=( const BasicExceptionMemoryPool& ) = delete;
+
+  /** Allocates \param thrown_size from the memory pool. If the exception size is to large for the
+    * pool to handle exception_too_large is called. If the memory pool is exhausted
+    * exception_memory_pool_exhausted is called. With thread quotas, exceptions beyond the quota
+    * of the calling thread are allocated from the fallback chain. Threads bound to a domain only
+    * allocate from it and from the fallback chain. Threads with a real-time scheduling policy
+    * allocate from the real-time lane first.
+    * \return Pointer to the allocated memory block.
+   */
+  inline void *allocate(const size_t thrown_size) noexcept {
+    if (m_domains.bound()) {
+      const auto ret = allocate_in_domain(thrown_size);
+      if constexpr (owner_tag_size > 0) {
+        owner_tag(ret) = nullptr;
+      }
+      return ret;
+    }
+    bool spilled = false;
+    if (m_lane.real_time() && thrown_size <= Lane::max_size) {
+      const auto ret = m_lane.allocate();
+      if (ret != nullptr) {
+        if constexpr (owner_tag_size > 0) {
+          owner_tag(ret) = nullptr;
+        }
+        return ret;
+      }
+      spilled = true;
+    }
+    if constexpr (owner_tag_size == 0) {
+      return allocate_unquoted(thrown_size, spilled);
+    }
+    else {
+      auto record = m_quotas.charge();
+      void *ret = nullptr;
+      if (record != nullptr) {
+        // A thread allocates from its reservation first.
+        if (thrown_size <= std::get<size_classes - 1>(m_classes).max_size) {
+          ret = m_quotas.take_reserved(record);
+        }
+        if (ret != nullptr) {
+          record = Quotas::stash_tag(record);
+          if (spilled) {
+            m_lane.note_spill();
+          }
+        }
+        else {
+          ret = allocate_unquoted(thrown_size, spilled);
+        }
+      }
+      else {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+        std::cerr << "Exception beyond the quota of the thread." << std::endl;
+#endif
+        ret = m_fallback.allocate(thrown_size);
+        if (ret == nullptr) {
+          ret = exception_memory_pool_exhausted(thrown_size);
+        }
+      }
+      owner_tag(ret) = record;
+      return ret;
+    }
+  }
+  /** Deallocates \param thrown_object from the pool. If the memory did not originate from this
+   *  memory pool exception_memory_pool_leak() is called.
+   */
+  inline void deallocate(void *thrown_object) noexcept {
+    // The tag is read before the segment can be handed out again.
+    const auto record = owner_tag_size > 0 ? owner_tag(thrown_object) : nullptr;
+    auto &largest = std::get<size_classes - 1>(m_classes);
+    if (Quotas::stashed(record) && largest.owns(thrown_object)) {
+      // Segments of a reservation go back to its stash, or to the size class if it shrank.
+      if (!m_quotas.restash(record, thrown_object)) {
+        largest.deallocate(thrown_object);
+      }
+      return;
+    }
+    if (!release(thrown_object)) {
+      leak();
+      return;
+    }
+    m_quotas.refund(record);
+  }
+
+  /** Sets the reservation of the calling thread to \param segments.
+   *  \return false if the thread quotas are disabled or the segments are not available.
+   */
+  inline bool reserve_thread_segments(const std::size_t segments) noexcept {
+    return m_quotas.reserve(segments);
+  }
+
+  /// \return The reservation of the calling thread.
+  inline std::size_t thread_reserved_segments() noexcept {
+    return m_quotas.reservation();
+  }
+
+  /// \return The domain named \param name with at least \param segments segments, see
+  /// PoolDomains::open().
+  inline exception_memory::DomainId open_domain(const char *name,
+                                                const std::size_t segments) noexcept {
+    return m_domains.open(name, segments);
+  }
+
+  /// Binds the calling thread to \param domain. \return false if \param domain is not open.
+  inline bool bind_thread_domain(const exception_memory::DomainId domain) noexcept {
+    return m_domains.bind(domain);
+  }
+
+  /// \return The domain the calling thread is bound to.
+  inline exception_memory::DomainId thread_domain() const noexcept {
+    return m_domains.current();
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The occupancy and the counters of \param domain. The size classes make up the
+   *  default domain, which has no counters.
+   */
+  inline exception_memory::DomainStatistics domain_statistics(
+      const exception_memory::DomainId domain) noexcept {
+    if (domain != exception_memory::default_domain) {
+      return m_domains.statistics(domain);
+    }
+    exception_memory::DomainStatistics stats{};
+    stats.name = "default";
+    stats.segments = capacity();
+    stats.used_segments = std::apply([](auto &... size_class) {
+      return (std::size_t() + ... + size_class.used_segments());
+    }, m_classes);
+    return stats;
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The number of used segments in the memory pool.
+   */
+  inline std::size_t used_segments() noexcept {
+    return dependent_statistics().used_segments + m_domains.used_segments() +
+        m_lane.used_segments() + m_elastic.used_segments() +
+        m_large.used_segments() + m_fallback.used_segments() +
+        std::apply([](auto &... size_class) {
+      return (std::size_t() + ... + size_class.used_segments());
+    }, m_classes);
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  Writes the occupancy of up to \param count size classes to \param stats.
+   *  \return The number of size classes.
+   */
+  inline std::size_t size_class_statistics(exception_memory::SizeClassStatistics *stats,
+                                           const std::size_t count) noexcept {
+    std::size_t idx = std::size_t();
+    const auto write = [&](auto &size_class) {
+      if (idx < count) {
+        stats[idx] = {size_class.segment_size, size_class.size, size_class.used_segments()};
+      }
+      ++idx;
+    };
+    std::apply([&write](auto &... size_class) {
+      (write(size_class), ...);
+    }, m_classes);
+    return size_classes;
+  }
+
+  /// Adds the counters of type Statistics of all size classes to \param stats.
+  template <typename Statistics>
+  inline void collect(Statistics &stats) const noexcept {
+    std::apply([&stats](const auto &... size_class) {
+      (size_class.collect(stats), ...);
+    }, m_classes);
+#if EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE > 0
+    m_dependent.collect(stats);
+#endif
+    m_domains.collect(stats);
+    m_lane.collect(stats);
+    m_quotas.collect(stats);
+    m_elastic.collect(stats);
+    m_large.collect(stats);
+    m_fallback.collect(stats);
+  }
+
+  /// \return The counters of type Statistics summed up over all size classes.
+  template <typename Statistics>
+  inline Statistics statistics() const noexcept {
+    Statistics stats{};
+    collect(stats);
+    return stats;
+  }
+
+  /** Allocates memory for a dependent exception. If the dependent exception pool is exhausted
+   *  exception_memory_pool_exhausted is called.
+   *  \return Pointer to the allocated memory block.
+   */
+  inline void *allocate_dependent() noexcept {
+    if (m_domains.bound()) {
+      return allocate_in_domain(sizeof (__cxxabiv1::__cxa_dependent_exception));
+    }
+#if EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE > 0
+    const auto ret = m_dependent.allocate();
+    if (ret != nullptr) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cout << "Allocate dependent: " << ret << std::endl;
+#endif
+      return ret;
+    }
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    std::cerr << "Dependent exception memory pool exhausted." << std::endl;
+#endif
+    const auto fallback = m_fallback.allocate(sizeof (__cxxabiv1::__cxa_dependent_exception));
+    return fallback != nullptr ? fallback :
+        exception_memory_pool_exhausted(sizeof (__cxxabiv1::__cxa_dependent_exception));
+#else
+    return allocate_unquoted(sizeof (__cxxabiv1::__cxa_dependent_exception));
+#endif
+  }
+
+  /** Deallocates the dependent exception \param dependent_object. If the memory did not originate
+   *  from this memory pool exception_memory_pool_leak() is called.
+   */
+  inline void deallocate_dependent(void *dependent_object) noexcept {
+#if EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE > 0
+    if (m_dependent.deallocate(dependent_object) || m_domains.deallocate(dependent_object) ||
+        m_fallback.deallocate(dependent_object)) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cout << "Free dependent: " << dependent_object << std::endl;
+#endif
+      return;
+    }
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    std::cerr << "Freeing dependent exception not from this pool. Memory leak present!" <<
+      std::endl;
+#endif
+    exception_memory_pool_leak();
+#else
+    if (!release(dependent_object)) {
+      leak();
+    }
+#endif
+  }
+
+  /** WARNING: This function is not thread safe! Only use it for testing!
+   *  \return The occupancy of the dependent exception pool. All values are 0 if dependent
+   *  exceptions are served from the exception memory pool.
+   */
+  inline exception_memory::SizeClassStatistics dependent_statistics() noexcept {
+#if EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE > 0
+    return {m_dependent.segment_size, m_dependent.size, m_dependent.used_segments()};
+#else
+    return exception_memory::SizeClassStatistics{};
+#endif
+  }
+
+  /** Faults in every page of the memory pool and locks it in RAM.
+   *  \return How much of the memory pool was prefaulted and locked.
+   */
+  inline exception_memory::PrefaultResult prefault_and_lock() noexcept {
+    exception_memory::PrefaultResult result{};
+    m_elastic.lock_added_slabs();
+    for_each_slab([&result](auto &slab) {
+      result.prefaulted_bytes += slab.prefault();
+      const auto error = slab.lock();
+      if (error == 0) {
+        result.locked_bytes += slab.size();
+      }
+      else if (result.lock_error == 0) {
+        result.lock_error = error;
+      }
+    });
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    if (result.lock_error != 0) {
+      std::cerr << "Could only lock " << result.locked_bytes << " of " <<
+        result.prefaulted_bytes << " bytes of the exception memory pool: " <<
+        strerror(result.lock_error) << std::endl;
+    }
+#endif
+    return result;
+  }
+
+  /** Returns the pages of free segments above the decaying high-water mark of every pool to the
+   *  kernel. Never called by allocate() or deallocate().
+   *  \return The number of bytes returned to the kernel.
+   */
+  inline std::size_t trim() noexcept {
+    std::size_t released = std::apply([](auto &... size_class) {
+      return (std::size_t() + ... + size_class.trim());
+    }, m_classes);
+#if EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE > 0
+    released += m_dependent.trim();
+#endif
+    released += m_domains.trim();
+    released += m_lane.trim();
+    released += m_large.trim();
+    released += m_fallback.trim();
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    std::cout << "Trimmed " << released << " bytes of the exception memory pool." << std::endl;
+#endif
+    return released;
+  }
+
+  /** Replaces the geometry of the memory pool with \param geometry.
+   *  \return false if the geometry is fixed at compile time, invalid or segments are in use.
+   */
+  inline bool configure(const exception_memory::PoolGeometry &geometry) noexcept {
+#ifdef EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY
+    return std::get<0>(m_classes).configure(geometry);
+#else
+    (void) geometry;
+    return false;
+#endif
+  }
+
+  /// \return The geometry of the largest size class.
+  inline exception_memory::PoolGeometry geometry() const noexcept {
+    const auto &pool = std::get<size_classes - 1>(m_classes);
+    return {pool.max_size, pool.size, pool.alignment};
+  }
+
+  /// \return The result of prefaulting the memory pool at startup. All values are 0 if the memory
+  /// pool is not prefaulted at startup.
+  inline exception_memory::PrefaultResult startup_prefault() const noexcept {
+    return m_startup_prefault;
+  }
+
+  /** Allocates and frees one segment of every size class and of the dependent exception pool.
+   *  This sets up the thread local state of the calling thread, e.g. its thread cache and its
+   *  scheduling policy, and brings the segments it will use next into its CPU cache.
+   */
+  inline void warm_up_thread() noexcept {
+    std::apply([](auto &... size_class) {
+      (warm_up(size_class), ...);
+    }, m_classes);
+#if EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE > 0
+    warm_up(m_dependent);
+#endif
+    m_lane.detect();
+    if constexpr (EXCEPTION_MEMORY__CXX_RT_LANE_SIZE > 0) {
+      if (m_lane.real_time()) {
+        warm_up(m_lane.pool());
+      }
+    }
+  }
+
+  /** Starts the helper thread growing the memory pool in elastic mode.
+   *  \return false if the elastic mode is disabled or the helper thread was started before.
+   */
+  inline bool start_elastic_growth() noexcept {
+    const auto used = std::apply([](auto &... size_class) {
+      return (std::size_t() + ... + size_class.used_segments());
+    }, m_classes);
+    return m_elastic.start(capacity(), used);
+  }
+
+  /// \return The fallback chain behind the memory pool.
+  inline auto &fallback() noexcept {
+    return m_fallback;
+  }
+
+  /// \returns if \param vptr was allocated from this memory pool.
+  inline bool is_allocated_by_this_pool(void *vptr) const noexcept {
+    void *ptr = (char *) vptr - object_offset;
+    return std::apply([ptr](const auto &... size_class) {
+      return (false || ... || size_class.owns(ptr));
+    }, m_classes);
+  }
+  private:
+  template <std::size_t... I>
+  static auto make_size_classes(std::index_sequence<I...>)
+      -> std::tuple<ExceptionSegmentPool<segment_sizes[I], segment_counts[I], Policies>...>;
+#ifdef EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY
+  using SizeClasses = std::tuple<RuntimeSegmentPool>;
+#else
+  using SizeClasses = decltype(make_size_classes(std::make_index_sequence<size_classes>()));
+#endif
+
+  SizeClasses m_classes;
+#if EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE > 0
+  using DependentPool = ExceptionSegmentPool<sizeof (__cxxabiv1::__cxa_dependent_exception),
+                                             EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE, Policies>;
+  DependentPool m_dependent;
+#endif
+  using LargeArena = std::conditional_t<(EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE > 0),
+      LargeExceptionArena<Policies, std::max(EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE,
+                                             EXCEPTION_MEMORY__CXX_LARGE_BLOCK_SIZE),
+                          EXCEPTION_MEMORY__CXX_LARGE_BLOCK_SIZE>,
+      NoLargeExceptionArena>;
+  LargeArena m_large;
+#ifdef EXCEPTION_MEMORY__CXX_DOMAIN_SIZES
+  using Domains = PoolDomains<Policies, segment_sizes[size_classes - 1],
+                              EXCEPTION_MEMORY__CXX_DOMAIN_SIZES>;
+#else
+  using Domains = PoolDomains<Policies, segment_sizes[size_classes - 1]>;
+#endif
+  Domains m_domains;
+  using Quotas = std::conditional_t<(EXCEPTION_MEMORY__CXX_THREAD_QUOTA > 0),
+      ThreadQuotas<std::tuple_element_t<size_classes - 1, SizeClasses>,
+                   EXCEPTION_MEMORY__CXX_THREAD_QUOTA, EXCEPTION_MEMORY__CXX_MAX_QUOTA_THREADS,
+                   Policies::statistics>,
+      NoThreadQuotas>;
+  Quotas m_quotas{std::get<size_classes - 1>(m_classes)};
+  using Lane = std::conditional_t<(EXCEPTION_MEMORY__CXX_RT_LANE_SIZE > 0),
+      RealTimeLane<Policies, segment_sizes[size_classes - 1],
+                   std::max(EXCEPTION_MEMORY__CXX_RT_LANE_SIZE, 1)>,
+      NoRealTimeLane>;
+  Lane m_lane;
+  using Elastic = std::conditional_t<(EXCEPTION_MEMORY__CXX_ELASTIC_SLABS > 0),
+      ElasticGrowth<Policies, segment_sizes[size_classes - 1],
+                    EXCEPTION_MEMORY__CXX_ELASTIC_SLAB_SIZE, EXCEPTION_MEMORY__CXX_ELASTIC_SLABS,
+                    EXCEPTION_MEMORY__CXX_ELASTIC_WATERMARK>,
+      NoElasticGrowth>;
+  Elastic m_elastic;
+  FallbackChain<Policies, segment_sizes[size_classes - 1]> m_fallback;
+  exception_memory::PrefaultResult m_startup_prefault{};
+
+  /// Calls \param function with every slab of the memory pool.
+  template <typename Function>
+  void for_each_slab(Function &&function) noexcept {
+    std::apply([&function](auto &... size_class) {
+      (size_class.for_each_slab(function), ...);
+    }, m_classes);
+#if EXCEPTION_MEMORY__CXX_DEPENDENT_POOL_SIZE > 0
+    m_dependent.for_each_slab(function);
+#endif
+    m_domains.for_each_slab(function);
+    m_lane.for_each_slab(function);
+    m_elastic.for_each_slab(function);
+    m_large.for_each_slab(function);
+    m_fallback.for_each_slab(function);
+  }
+
+  /// \return The number of segments of all size classes.
+  std::size_t capacity() const noexcept {
+    return std::apply([](const auto &... size_class) {
+      return (std::size_t() + ... + size_class.size);
+    }, m_classes);
+  }
+
+  /// \return The tag in front of the header of the exception in \param ptr naming its quota.
+  static typename Quotas::Record *&owner_tag(void *ptr) noexcept {
+    return *reinterpret_cast<typename Quotas::Record **>(
+        static_cast<char *>(ptr) + object_offset - header_size - owner_tag_size);
+  }
+
+  /// \return Memory for \param thrown_size from the domain of the calling thread or, if it is
+  /// exhausted or \param thrown_size is too large for it, from the fallback chain.
+  void *allocate_in_domain(const size_t thrown_size) noexcept {
+    auto ret = thrown_size <= Domains::max_size ? m_domains.allocate() : nullptr;
+    if (ret == nullptr) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cerr << "Memory pool domain exhausted." << std::endl;
+#endif
+      ret = m_fallback.allocate(thrown_size);
+    }
+    if (ret == nullptr) {
+      ret = thrown_size <= Domains::max_size ? exception_memory_pool_exhausted(thrown_size) :
+          exception_too_large(thrown_size);
+    }
+    return ret;
+  }
+
+  /// \return Memory for \param thrown_size from the first tier which can serve it, without
+  /// charging it to a quota. \param spilled Whether the real-time lane was exhausted.
+  void *allocate_unquoted(const size_t thrown_size, const bool spilled = false) noexcept {
+    if (thrown_size > std::get<size_classes - 1>(m_classes).max_size) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cerr << "Exception too large." << std::endl;
+#endif
+      auto ret = m_large.allocate(thrown_size);
+      if (ret == nullptr) {
+        ret = m_fallback.allocate(thrown_size);
+      }
+      return ret != nullptr ? ret : exception_too_large(thrown_size);
+    }
+    auto ret = allocate_from<0>(thrown_size);
+    if (ret != nullptr) {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+      std::cout << "Allocate: " << ret << std::endl;
+#endif
+      m_elastic.note_allocated();
+      if (spilled) {
+        m_lane.note_spill();
+      }
+      return ret;
+    }
+    ret = m_elastic.allocate(thrown_size);
+    if (ret != nullptr) {
+      if (spilled) {
+        m_lane.note_spill();
+      }
+      return ret;
+    }
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    std::cerr << "Memory pool exhausted." << std::endl;
+#endif
+    ret = m_fallback.allocate(thrown_size);
+    // Callback could provide additional memory.
+    return ret != nullptr ? ret : exception_memory_pool_exhausted(thrown_size);
+  }
+
+  /// Returns \param ptr to the tier it was allocated from. \return false if no tier owns it.
+  bool release(void *ptr) noexcept {
+    if (deallocate_to<0>(ptr)) {
+      m_elastic.note_freed();
+    }
+    else if (!m_domains.deallocate(ptr) && !m_lane.deallocate(ptr) &&
+             !m_elastic.deallocate(ptr) && !m_large.deallocate(ptr) &&
+             !m_fallback.deallocate(ptr)) {
+      return false;
+    }
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    std::cout << "Free: " << ptr << std::endl;
+#endif
+    return true;
+  }
+
+  /// Reports memory freed to the pool which did not originate from it.
+  static void leak() noexcept {
+#ifdef EXCEPTION_MEMORY___CXX_LOG_MEMORY_POOL
+    std::cerr << "Freeing exception not from this pool. Memory leak present!" << std::endl;
+#endif
+    exception_memory_pool_leak();
+  }
+
+  /// Allocates, touches and frees one segment of \param pool.
+  template <typename Pool>
+  static void warm_up(Pool &pool) noexcept {
+    const auto ptr = pool.allocate();
+    if (ptr != nullptr) {
+      memset(ptr, 0, pool.segment_size);
+      pool.deallocate(ptr);
+    }
+  }
+
+  /// \return Memory for \param thrown_size from size class I or a larger one, nullptr if all
+  /// fitting size classes are exhausted.
+  template <std::size_t I>
+  void *allocate_from(const size_t thrown_size) noexcept {
+    if constexpr (I == size_classes) {
+      return nullptr;
+    }
+    else {
+      if (thrown_size <= std::get<I>(m_classes).max_size) {
+        const auto ret = std::get<I>(m_classes).allocate();
+        if (ret != nullptr) {
+          return ret;
+        }
+      }
+      return allocate_from<I + 1>(thrown_size);
+    }
+  }
+
+  /// Returns \param ptr to the size class owning it. \return false if no size class owns it.
+  template <std::size_t I>
+  bool deallocate_to(void *ptr) noexcept {
+    if constexpr (I == size_classes) {
+      return false;
+    }
+    else {
+      return std::get<I>(m_classes).deallocate(ptr) || deallocate_to<I + 1>(ptr);
+    }
+  }
+};
+
+/// Exception memory pool built from the policies chosen by the EXCEPTION_MEMORY__CXX_* defines.
+using ExceptionMemoryPool = BasicExceptionMemoryPool<DefaultPolicies>;
+
+}
+}
+
+#endif //STATIC_EXCEPTION_EXCEPTION_MEMORY_POOL_HPP
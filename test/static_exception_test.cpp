@@ -12,16 +12,26 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <atomic>
+#include <csignal>
 #include <ctime>
 #include <chrono>
 #include <thread>
 #include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <memory_resource>
 #include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <dlfcn.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 
 #include "SomeClass.hpp"
+#include "static_exception.hpp"
 
 #define EXCEPTION_MEMORY_USE_STATIC_EXCEPTION
 
@@ -38,8 +48,6 @@ extern inline void cxa_free_exception(void *vptr) noexcept;
 }
 }
 
-extern std::size_t __get_exception_memory_pool_used_segments();
-
 /// Custom malloc to check for memory allocation.
 void *malloc(size_t size) {
   static void *(*real_malloc)(size_t) = nullptr;
@@ -99,6 +107,15 @@ void check_used_segments(std::size_t expected) {
   g_forbid_malloc = prev;
 }
 
+/// \return The segments of the largest size class once every elastic slab is added.
+constexpr std::size_t max_pool_segments() {
+#if EXCEPTION_MEMORY__CXX_ELASTIC_SLABS > 0
+  return 64*128 + EXCEPTION_MEMORY__CXX_ELASTIC_SLABS * 1024;
+#else
+  return 64*128;
+#endif
+}
+
 TEST(StaticExceptions, DeepRecursion) {
   check_used_segments(0);
 
@@ -168,6 +185,260 @@ TEST(StaticExceptions, ExceptionPtr) {
   g_forbid_malloc = false;
 }
 
+TEST(StaticExceptions, DependentExceptionPool) {
+  if (__get_exception_memory_pool_dependent_statistics().segments == 0) {
+    return; // Dependent exceptions are served from the exception memory pool.
+  }
+  std::exception_ptr eptr;
+  try {
+    throw MyException();
+  } catch(...) {
+    eptr = std::current_exception();
+  }
+  try {
+    std::rethrow_exception(eptr);
+  } catch(...) {
+    const auto stats = __get_exception_memory_pool_dependent_statistics();
+    EXPECT_EQ(stats.used_segments, 1u);
+    // The segments are sized for a dependent exception only.
+#ifdef EXCEPTION_MEMORY__CXX_COLOUR_SLOTS
+    // Colouring adds up to one cache line.
+    EXPECT_LE(stats.segment_size, 192u);
+#else
+    EXPECT_LE(stats.segment_size, 128u);
+#endif
+  }
+  EXPECT_EQ(__get_exception_memory_pool_dependent_statistics().used_segments, 0u);
+}
+
+TEST(StaticExceptions, SegmentColouring) {
+#ifdef EXCEPTION_MEMORY__CXX_COLOUR_SLOTS
+  // Live exceptions of neighbouring segments spread over the 64 sets of a 4096 byte cache way
+  // instead of landing on the same few, 4 with plain 1024 byte segments.
+  std::vector<std::exception_ptr> held;
+  for (std::size_t i = 0; i < 64; ++i) {
+    held.push_back(std::make_exception_ptr(MyException()));
+  }
+  std::vector<std::uintptr_t> addresses;
+  for (const auto &eptr : held) {
+    try {
+      std::rethrow_exception(eptr);
+    } catch (const MyException &e) {
+      addresses.push_back(reinterpret_cast<std::uintptr_t>(&e));
+    }
+  }
+  std::sort(addresses.begin(), addresses.end());
+  std::vector<bool> sets(64);
+  std::size_t neighbours = 0;
+  for (std::size_t i = 0; i < addresses.size(); ++i) {
+    sets[addresses[i] % 4096 / 64] = true;
+    if (i > 0 && addresses[i] - addresses[i - 1] < 2048) {
+      ++neighbours;
+      // The stride of neighbouring segments is no multiple of the way size.
+      EXPECT_NE(addresses[i] % 4096, addresses[i - 1] % 4096);
+    }
+  }
+  EXPECT_GT(neighbours, 0u);
+  EXPECT_GE(std::count(sets.begin(), sets.end(), true), 32);
+#endif
+}
+
+TEST(StaticExceptions, ObjectAlignment) {
+#ifdef EXCEPTION_MEMORY__CXX_OBJECT_ALIGNMENT
+  constexpr std::uintptr_t alignment = EXCEPTION_MEMORY__CXX_OBJECT_ALIGNMENT;
+#else
+  constexpr std::uintptr_t alignment = __BIGGEST_ALIGNMENT__;
+#endif
+  // Nested throws land in different segments and, with size classes, in different classes.
+  std::vector<std::uintptr_t> addresses;
+  for (int i = 0; i < 8; ++i) {
+    try {
+      throw MyException();
+    } catch (const MyException &e) {
+      addresses.push_back(reinterpret_cast<std::uintptr_t>(&e));
+      try {
+        throw std::array<char, 3>();
+      } catch (const std::array<char, 3> &a) {
+        addresses.push_back(reinterpret_cast<std::uintptr_t>(&a));
+      }
+    }
+  }
+  for (const auto address : addresses) {
+    EXPECT_EQ(address % alignment, 0u);
+  }
+}
+
+TEST(StaticExceptions, PoolGeometry) {
+  const auto geometry = exception_memory::pool_geometry();
+#ifdef EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY
+  // The ctest environment overrides the compile time geometry, run directly it is kept.
+  const char *segment_size = getenv("EXCEPTION_MEMORY_SEGMENT_SIZE");
+  const char *segments = getenv("EXCEPTION_MEMORY_SEGMENTS");
+  if (segment_size != nullptr && segments != nullptr) {
+    EXPECT_EQ(geometry.segment_size, std::stoul(segment_size));
+    EXPECT_EQ(geometry.segments, std::stoul(segments));
+  }
+  else {
+    EXPECT_GT(geometry.segments, 0u);
+  }
+  EXPECT_FALSE(exception_memory::configure_pool({geometry.segment_size, 0, 8}));
+  try {
+    throw MyException();
+  } catch(...) {
+    EXPECT_FALSE(exception_memory::configure_pool(geometry));
+  }
+  EXPECT_TRUE(exception_memory::configure_pool({geometry.segment_size, 16, 8}));
+  EXPECT_EQ(exception_memory::pool_geometry().segments, 16u);
+  EXPECT_DEATH(recursive_except(16), "");
+  EXPECT_TRUE(exception_memory::configure_pool(geometry));
+  EXPECT_EQ(exception_memory::pool_geometry().segments, geometry.segments);
+#else
+  EXPECT_GT(geometry.segments, 0u);
+  EXPECT_FALSE(exception_memory::configure_pool(geometry));
+#endif
+}
+
+TEST(StaticExceptions, PoolBacking) {
+  const auto backing = __get_exception_memory_pool_backing_statistics();
+  // Slabs added by the ElasticGrowth test are always mapped.
+  const auto mapped = backing.page_slabs + backing.huge_page_slabs +
+    backing.transparent_huge_page_slabs - __get_exception_memory_pool_elastic_statistics().slabs;
+#if defined(EXCEPTION_MEMORY__CXX_USE_HUGE_PAGES) || EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE > 0
+  EXPECT_EQ(backing.heap_slabs, 0u);
+  EXPECT_EQ(backing.static_slabs, 0u);
+  EXPECT_GT(mapped, 0u);
+#elif defined(EXCEPTION_MEMORY__CXX_RUNTIME_GEOMETRY)
+  // Only the size classes are sized at runtime.
+  EXPECT_GT(backing.heap_slabs, 0u);
+  EXPECT_EQ(mapped, 0u);
+#else
+  EXPECT_EQ(backing.heap_slabs, 0u);
+  EXPECT_GT(backing.static_slabs, 0u);
+  EXPECT_EQ(mapped, 0u);
+#endif
+}
+
+/// Used segments while an exception thrown by a static initializer is caught.
+static const std::size_t g_static_init_used_segments = []() {
+  try {
+    throw MyException();
+  } catch (const MyException &) {
+    return __get_exception_memory_pool_used_segments();
+  }
+}();
+
+TEST(StaticExceptions, StaticInitialization) {
+  EXPECT_EQ(g_static_init_used_segments, 1u);
+}
+
+TEST(StaticExceptions, CommittedSize) {
+  try {
+    throw std::runtime_error("commit");
+  } catch (const std::runtime_error &) {
+  }
+  const auto stats = __get_exception_memory_pool_commit_statistics();
+  EXPECT_GT(stats.reserved_bytes, 0u);
+#if EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE > 0
+  EXPECT_GT(stats.committed_bytes, 0u);
+  EXPECT_EQ(stats.committed_bytes % EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE, 0u);
+  EXPECT_LT(stats.committed_bytes, stats.reserved_bytes);
+#else
+  EXPECT_EQ(stats.committed_bytes, stats.reserved_bytes);
+#endif
+}
+
+TEST(StaticExceptions, Trim) {
+  {
+    std::vector<std::exception_ptr> burst;
+    for (int i = 0; i < 2000; ++i) {
+      burst.push_back(std::make_exception_ptr(std::runtime_error("burst")));
+    }
+  }
+  const auto committed = __get_exception_memory_pool_commit_statistics().committed_bytes;
+  const auto released = exception_memory::trim();
+#ifndef EXCEPTION_MEMORY__CXX_PREFAULT_AND_LOCK
+  EXPECT_GT(released, 0u);
+#endif
+  EXPECT_EQ(__get_exception_memory_pool_used_segments(), 0u);
+#if EXCEPTION_MEMORY__CXX_COMMIT_CHUNK_SIZE > 0
+  EXPECT_EQ(__get_exception_memory_pool_commit_statistics().committed_bytes,
+            committed - released);
+#else
+  (void) committed;
+#endif
+  try {
+    throw std::runtime_error("after trim");
+  } catch (const std::runtime_error &) {
+  }
+  EXPECT_EQ(__get_exception_memory_pool_used_segments(), 0u);
+}
+
+// Allocations never fail while a trim claims free segments, large exceptions which find the arena
+// exhausted while its trim holds the free blocks wait for it.
+TEST(StaticExceptions, TrimWhileThrowing) {
+  std::atomic<bool> done{false};
+  std::thread trimmer([&done]() {
+    while (!done.load()) {
+      exception_memory::trim();
+    }
+  });
+  for (int i = 0; i < 200000; ++i) {
+    try {
+      throw std::runtime_error("during trim");
+    } catch (const std::runtime_error &) {
+    }
+#if EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE > 0
+    // Takes the whole arena, which the trim holds while it releases its pages.
+    struct WholeArena {
+      char data[EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE / 2];
+    };
+    if (i % 16 == 0) {
+      try {
+        throw WholeArena();
+      } catch (const WholeArena &) {
+      }
+    }
+#endif
+  }
+  done.store(true);
+  trimmer.join();
+  EXPECT_EQ(__get_exception_memory_pool_used_segments(), 0u);
+}
+
+TEST(StaticExceptions, PrefaultAndLock) {
+  const auto startup = __get_exception_memory_pool_startup_prefault();
+#ifdef EXCEPTION_MEMORY__CXX_PREFAULT_AND_LOCK
+  EXPECT_GT(startup.prefaulted_bytes, 0u);
+#else
+  EXPECT_EQ(startup.prefaulted_bytes, 0u);
+#endif
+  const auto result = exception_memory::prefault_and_lock();
+  EXPECT_GT(result.prefaulted_bytes, 0u);
+  const auto commit = __get_exception_memory_pool_commit_statistics();
+  EXPECT_EQ(commit.committed_bytes, commit.reserved_bytes);
+  // Locking fails if RLIMIT_MEMLOCK is too low, which must be reported.
+  if (result.lock_error == 0) {
+    EXPECT_EQ(result.locked_bytes, result.prefaulted_bytes);
+  }
+  else {
+    EXPECT_LT(result.locked_bytes, result.prefaulted_bytes);
+  }
+  // Locked pages cannot be trimmed by later tests.
+  munlockall();
+}
+
+TEST(StaticExceptions, WarmUpThread) {
+  std::thread([] {
+    exception_memory::warm_up_thread();
+    EXPECT_EQ(__get_exception_memory_pool_used_segments(), 0u);
+    try {
+      throw std::runtime_error("warm");
+    } catch (const std::runtime_error &) {
+    }
+  }).join();
+  EXPECT_EQ(__get_exception_memory_pool_used_segments(), 0u);
+}
+
 TEST(StaticExceptions, ExceptionTooLarge) {
   class LargeException {
     char data[1024];
@@ -177,23 +448,504 @@ TEST(StaticExceptions, ExceptionTooLarge) {
     char data[800];
   };
   try {
+#if EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE > 0
+    try {
+      throw LargeException();
+    } catch(const LargeException &) {
+    }
+#else
     ASSERT_DEATH(throw LargeException(), "");
+#endif
     throw SmallerException();
   } catch(...) {
 
   }
 }
 
+#if EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE > 0
+/// Throws \param count nested exceptions of 8 KiB, which take a 16 KiB block with the header.
+void recursive_large_except(const std::size_t count) {
+  class LargeException {
+    char data[8192];
+  };
+  if (count == 0) {
+    const auto stats = __get_exception_memory_pool_large_statistics();
+    EXPECT_EQ(stats.used_bytes, EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE);
+    return;
+  }
+  try {
+    throw LargeException();
+  } catch(const LargeException &) {
+    recursive_large_except(count - 1);
+  }
+}
+
+TEST(StaticExceptions, LargeExceptionArena) {
+  const auto before = __get_exception_memory_pool_large_statistics();
+  EXPECT_EQ(before.arena_bytes, EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE);
+  EXPECT_EQ(before.used_bytes, 0u);
+  // Fills the arena, merging the blocks again between the runs.
+  for (std::size_t i = 0; i < 4; ++i) {
+    recursive_large_except(EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE / 16384);
+  }
+  const auto after = __get_exception_memory_pool_large_statistics();
+  EXPECT_EQ(after.used_bytes, 0u);
+  EXPECT_EQ(after.allocations - before.allocations, 4 * EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE / 16384);
+  EXPECT_EQ(after.failures, before.failures);
+  check_used_segments(0);
+  ASSERT_DEATH(recursive_large_except(EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE / 16384 + 1), "");
+}
+#endif
+
+TEST(StaticExceptions, SizeClassOccupancy) {
+  // Expects the smallest size class to fit an int and only the largest one to fit MyException.
+  std::array<exception_memory::SizeClassStatistics, 16> stats;
+  try {
+    throw 42;
+  } catch(...) {
+    const auto size_classes =
+      __get_exception_memory_pool_size_class_statistics(stats.data(), stats.size());
+    ASSERT_GE(size_classes, 1u);
+    ASSERT_LE(size_classes, stats.size());
+    EXPECT_EQ(stats[0].used_segments, 1u);
+    for (std::size_t i = 1; i < size_classes; ++i) {
+      EXPECT_EQ(stats[i].used_segments, 0u);
+    }
+  }
+  try {
+    throw MyException();
+  } catch(...) {
+    const auto size_classes =
+      __get_exception_memory_pool_size_class_statistics(stats.data(), stats.size());
+    EXPECT_EQ(stats[size_classes - 1].used_segments, 1u);
+    for (std::size_t i = 0; i + 1 < size_classes; ++i) {
+      EXPECT_EQ(stats[i].used_segments, 0u);
+    }
+  }
+}
+
+TEST(StaticExceptions, FallbackChain) {
+  using exception_memory::FallbackTier;
+  class LargeException {
+    char data[1024];
+  };
+  const auto before = __get_exception_memory_pool_fallback_statistics();
+
+  // libstdc++ terminates instead of failing, no tier can follow it.
+  const FallbackTier unreachable[] = {FallbackTier::libstdcxx, FallbackTier::memory_resource};
+  EXPECT_FALSE(exception_memory::set_fallback_chain(unreachable, 2));
+
+  const FallbackTier libstdcxx[] = {FallbackTier::libstdcxx};
+  EXPECT_TRUE(exception_memory::set_fallback_chain(libstdcxx, 1));
+  recursive_except(max_pool_segments());
+  try {
+    throw LargeException();
+  } catch(...) {
+  }
+  check_used_segments(0);
+  auto after = __get_exception_memory_pool_fallback_statistics();
+  // Large exceptions only reach the fallback chain without a large exception arena.
+#if EXCEPTION_MEMORY__CXX_LARGE_ARENA_SIZE > 0
+  const std::uint64_t large_fallbacks = 0;
+#else
+  const std::uint64_t large_fallbacks = 1;
+#endif
+  EXPECT_GE(after.libstdcxx_hits - before.libstdcxx_hits, 1 + large_fallbacks);
+
+  const FallbackTier resource[] = {FallbackTier::memory_resource};
+  exception_memory::set_fallback_memory_resource(std::pmr::new_delete_resource());
+  EXPECT_TRUE(exception_memory::set_fallback_chain(resource, 1));
+  recursive_except(max_pool_segments());
+  check_used_segments(0);
+  after = __get_exception_memory_pool_fallback_statistics();
+  EXPECT_GE(after.memory_resource_hits - before.memory_resource_hits, 1u);
+
+  const FallbackTier overflow[] = {FallbackTier::overflow_pool, FallbackTier::libstdcxx};
+#if EXCEPTION_MEMORY__CXX_OVERFLOW_POOL_SIZE > 0
+  EXPECT_TRUE(exception_memory::set_fallback_chain(overflow, 2));
+  recursive_except(max_pool_segments() + 8);
+  try {
+    throw LargeException();
+  } catch(...) {
+  }
+  check_used_segments(0);
+  after = __get_exception_memory_pool_fallback_statistics();
+  EXPECT_GE(after.overflow_pool_hits - before.overflow_pool_hits, 9u);
+  EXPECT_GE(after.libstdcxx_hits - before.libstdcxx_hits, 1 + 2 * large_fallbacks);
+#else
+  EXPECT_FALSE(exception_memory::set_fallback_chain(overflow, 2));
+#endif
+  EXPECT_EQ(after.failures, before.failures);
+
+  exception_memory::set_fallback_memory_resource(nullptr);
+  EXPECT_TRUE(exception_memory::set_fallback_chain(nullptr, 0));
+}
+
 TEST(StaticExceptions, MemoryPoolExhausted) {
-  ASSERT_DEATH(recursive_except(64*128), "");
+  // Slabs added by the ElasticGrowth test stay in the memory pool.
+  ASSERT_DEATH(recursive_except(max_pool_segments()), "");
 }
 
 TEST(StaticExceptions, MemoryLeak) {
   void* som_mem = new char;
   ASSERT_DEATH(exception_memory::__cxx::cxa_free_exception(som_mem), "");
   ASSERT_DEATH(exception_memory::__cxx::cxa_free_dependent_exception(som_mem), "");
+  // A pointer of no tier is reported without reading memory before it, even while blocks of the
+  // fallback chain are live.
+  EXPECT_EXIT({
+    exception_memory::set_fallback_memory_resource(std::pmr::new_delete_resource());
+    const exception_memory::FallbackTier resource[] = {
+      exception_memory::FallbackTier::memory_resource};
+    exception_memory::set_fallback_chain(resource, 1);
+    std::vector<std::exception_ptr> held;
+    for (std::size_t i = 0; i <= max_pool_segments(); ++i) {
+      held.push_back(std::make_exception_ptr(MyException()));
+    }
+    const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const auto mapping = static_cast<char *>(mmap(nullptr, 2 * page, PROT_NONE,
+                                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    mprotect(mapping + page, page, PROT_READ | PROT_WRITE);
+    exception_memory::__cxx::cxa_free_dependent_exception(mapping + page);
+  }, testing::KilledBySignal(SIGABRT), "");
+}
+
+TEST(StaticExceptions, ThreadQuota) {
+#if EXCEPTION_MEMORY__CXX_THREAD_QUOTA > 0
+  using exception_memory::FallbackTier;
+  const FallbackTier libstdcxx[] = {FallbackTier::libstdcxx};
+  ASSERT_TRUE(exception_memory::set_fallback_chain(libstdcxx, 1));
+  const auto before = __get_exception_memory_pool_quota_statistics();
+  // The exception beyond the cap goes to the fallback chain.
+  recursive_except(EXCEPTION_MEMORY__CXX_THREAD_QUOTA);
+  auto stats = __get_exception_memory_pool_quota_statistics();
+  EXPECT_EQ(stats.cap_rejections - before.cap_rejections, 1u);
+
+  // Reserving claims the segments, other threads only get the remaining ones.
+  ASSERT_TRUE(exception_memory::reserve_thread_segments(2048));
+  EXPECT_EQ(exception_memory::thread_reserved_segments(), 2048u);
+  check_used_segments(2048);
+  std::array<std::vector<std::exception_ptr>, 8> held;
+  std::array<std::thread, 8> threads;
+  for (std::size_t i = 0; i < threads.size(); ++i) {
+    threads[i] = std::thread([&held, i]() {
+      for (std::size_t j = 0; j < EXCEPTION_MEMORY__CXX_THREAD_QUOTA; ++j) {
+        held[i].push_back(std::make_exception_ptr(MyException()));
+      }
+    });
+  }
+  for (auto &elem : threads) {
+    elem.join();
+  }
+  // The other threads exhausted the memory pool and went to the fallback chain, the reserved
+  // segments are still available to this thread.
+  check_used_segments(64*128);
+  std::vector<std::exception_ptr> reserved;
+  for (std::size_t i = 0; i < 2048; ++i) {
+    reserved.push_back(std::make_exception_ptr(MyException()));
+  }
+  check_used_segments(64*128);
+  stats = __get_exception_memory_pool_quota_statistics();
+  EXPECT_EQ(stats.reserved_segments, 2048u);
+  EXPECT_EQ(stats.held_segments, 2048u);
+
+  // Growing the reservation fails if the memory pool is exhausted.
+  {
+    exception_memory::ReserveScope scope(1);
+    EXPECT_FALSE(scope);
+  }
+  stats = __get_exception_memory_pool_quota_statistics();
+  EXPECT_EQ(stats.reservation_rejections - before.reservation_rejections, 1u);
+
+  // Segments in flight stay claimed until they are freed.
+  ASSERT_TRUE(exception_memory::reserve_thread_segments(0));
+  EXPECT_EQ(__get_exception_memory_pool_quota_statistics().held_segments, 2048u);
+  reserved.clear();
+  stats = __get_exception_memory_pool_quota_statistics();
+  EXPECT_EQ(stats.held_segments, 0u);
+  EXPECT_EQ(stats.reserved_segments, 0u);
+  {
+    exception_memory::ReserveScope scope(1024);
+    EXPECT_TRUE(scope);
+    EXPECT_EQ(exception_memory::thread_reserved_segments(), 1024u);
+  }
+  EXPECT_EQ(exception_memory::thread_reserved_segments(), 0u);
+  for (auto &elem : held) {
+    elem.clear();
+  }
+  check_used_segments(0);
+
+  // A thread gives its reservation back when it exits.
+  std::thread([]() {
+    ASSERT_TRUE(exception_memory::reserve_thread_segments(16));
+    recursive_except(4);
+  }).join();
+  stats = __get_exception_memory_pool_quota_statistics();
+  EXPECT_EQ(stats.held_segments, 0u);
+  EXPECT_EQ(stats.reserved_segments, 0u);
+  check_used_segments(0);
+  EXPECT_TRUE(exception_memory::set_fallback_chain(nullptr, 0));
+#else
+  EXPECT_FALSE(exception_memory::reserve_thread_segments(1));
+  exception_memory::ReserveScope scope(1);
+  EXPECT_FALSE(scope);
+  EXPECT_EQ(__get_exception_memory_pool_quota_statistics().tracked_threads, 0u);
+#endif
+}
+
+TEST(StaticExceptions, PoolDomains) {
+#ifdef EXCEPTION_MEMORY__CXX_DOMAIN_SIZES
+  using exception_memory::FallbackTier;
+  // A new name gets the smallest domain large enough, an open name its domain.
+  const auto perception = exception_memory::open_domain("perception", 64);
+  ASSERT_NE(perception, exception_memory::invalid_domain);
+  EXPECT_EQ(exception_memory::open_domain("perception", 1), perception);
+  EXPECT_EQ(exception_memory::open_domain("perception", 65), exception_memory::invalid_domain);
+  const auto planning = exception_memory::open_domain("planning", 65);
+  ASSERT_NE(planning, exception_memory::invalid_domain);
+  EXPECT_NE(planning, perception);
+  EXPECT_EQ(exception_memory::open_domain("control", 1), exception_memory::invalid_domain);
+  // The test variant has two domains.
+  EXPECT_FALSE(exception_memory::bind_thread_domain(3));
+
+  // An exhausted domain goes to the fallback chain, the memory pool is left untouched.
+  const FallbackTier libstdcxx[] = {FallbackTier::libstdcxx};
+  ASSERT_TRUE(exception_memory::set_fallback_chain(libstdcxx, 1));
+  std::vector<std::exception_ptr> held;
+  {
+    exception_memory::DomainScope scope(perception);
+    EXPECT_TRUE(scope);
+    EXPECT_EQ(exception_memory::thread_domain(), perception);
+    for (std::size_t i = 0; i < 65; ++i) {
+      held.push_back(std::make_exception_ptr(MyException()));
+    }
+  }
+  EXPECT_EQ(exception_memory::thread_domain(), exception_memory::default_domain);
+  auto stats = __get_exception_memory_pool_domain_statistics(perception);
+  EXPECT_STREQ(stats.name, "perception");
+  EXPECT_EQ(stats.segments, 64u);
+  EXPECT_EQ(stats.used_segments, 64u);
+  EXPECT_EQ(stats.allocations, 64u);
+  EXPECT_EQ(stats.failures, 1u);
+  EXPECT_EQ(__get_exception_memory_pool_domain_statistics(exception_memory::default_domain)
+                .used_segments, 0u);
+
+  // Bindings are per thread. Dependent exceptions come from the domain as well, exceptions
+  // too large for a segment from the fallback chain.
+  class LargeException {
+    char data[64*1024];
+  };
+  auto error = std::make_exception_ptr(MyException());
+  const auto fallback = __get_exception_memory_pool_fallback_statistics();
+  std::thread([planning, &error]() {
+    ASSERT_TRUE(exception_memory::bind_thread_domain(planning));
+    recursive_except(16);
+    try {
+      std::rethrow_exception(error);
+    } catch (const MyException &) {
+    }
+    try {
+      throw LargeException();
+    } catch (const LargeException &) {
+    }
+  }).join();
+  error = nullptr;
+  stats = __get_exception_memory_pool_domain_statistics(planning);
+  EXPECT_STREQ(stats.name, "planning");
+  EXPECT_EQ(stats.allocations, 18u);
+  EXPECT_EQ(stats.used_segments, 0u);
+  EXPECT_EQ(__get_exception_memory_pool_fallback_statistics().libstdcxx_hits,
+            fallback.libstdcxx_hits + 1);
+  held.clear();
+  check_used_segments(0);
+  EXPECT_TRUE(exception_memory::set_fallback_chain(nullptr, 0));
+#else
+  EXPECT_EQ(exception_memory::open_domain("perception", 1), exception_memory::invalid_domain);
+  EXPECT_FALSE(exception_memory::bind_thread_domain(1));
+  EXPECT_TRUE(exception_memory::bind_thread_domain(exception_memory::default_domain));
+  EXPECT_EQ(exception_memory::thread_domain(), exception_memory::default_domain);
+#endif
+  const auto pool = __get_exception_memory_pool_domain_statistics(
+      exception_memory::default_domain);
+  EXPECT_STREQ(pool.name, "default");
+  EXPECT_EQ(pool.used_segments, 0u);
+}
+
+TEST(StaticExceptions, RealTimeLane) {
+  const auto before = __get_exception_memory_pool_real_time_lane_statistics();
+#if EXCEPTION_MEMORY__CXX_RT_LANE_SIZE > 0
+  EXPECT_EQ(before.segments, std::size_t(EXCEPTION_MEMORY__CXX_RT_LANE_SIZE));
+  // Best-effort threads never use the lane.
+  recursive_except(16);
+  auto stats = __get_exception_memory_pool_real_time_lane_statistics();
+  EXPECT_EQ(stats.lane_allocations, before.lane_allocations);
+
+  bool real_time = false;
+  std::thread([&real_time]() {
+    sched_param param{};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    real_time = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    if (!real_time) {
+      return;
+    }
+    exception_memory::warm_up_thread();
+    // A thread regaining its real-time policy is counted once.
+    sched_param other{};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &other);
+    exception_memory::warm_up_thread();
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    exception_memory::warm_up_thread();
+    // The lane is filled first, the last exception spills into the memory pool.
+    std::vector<std::exception_ptr> held;
+    for (std::size_t i = 0; i < EXCEPTION_MEMORY__CXX_RT_LANE_SIZE + 1; ++i) {
+      held.push_back(std::make_exception_ptr(MyException()));
+    }
+    EXPECT_EQ(__get_exception_memory_pool_real_time_lane_statistics().used_segments,
+              std::size_t(EXCEPTION_MEMORY__CXX_RT_LANE_SIZE));
+    check_used_segments(EXCEPTION_MEMORY__CXX_RT_LANE_SIZE + 1);
+  }).join();
+  if (!real_time) {
+    GTEST_SKIP() << "SCHED_FIFO is not permitted.";
+  }
+  stats = __get_exception_memory_pool_real_time_lane_statistics();
+  EXPECT_EQ(stats.real_time_threads - before.real_time_threads, 1u);
+  EXPECT_EQ(stats.lane_allocations - before.lane_allocations,
+            std::uint64_t(EXCEPTION_MEMORY__CXX_RT_LANE_SIZE));
+  EXPECT_EQ(stats.spilled_allocations - before.spilled_allocations, 1u);
+  EXPECT_EQ(stats.used_segments, 0u);
+  check_used_segments(0);
+#else
+  EXPECT_EQ(before.segments, 0u);
+  EXPECT_EQ(before.lane_allocations, 0u);
+#endif
 }
 
+TEST(StaticExceptions, ElasticGrowth) {
+#if EXCEPTION_MEMORY__CXX_ELASTIC_SLABS > 0
+  // The helper thread may already run if the test is repeated.
+  const auto prefaulted = exception_memory::prefault_and_lock().prefaulted_bytes;
+  exception_memory::start_elastic_growth();
+  EXPECT_FALSE(exception_memory::start_elastic_growth());
+  std::vector<std::exception_ptr> held;
+  held.reserve(64*128 + 512);
+  // Crosses the watermark of 75 % and waits for the helper thread to add a slab.
+  for (std::size_t i = 0; i < 7000; ++i) {
+    held.push_back(std::make_exception_ptr(MyException()));
+  }
+  for (std::size_t i = 0; i < 1000 &&
+       __get_exception_memory_pool_elastic_statistics().slabs == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // Exhausts the memory pool, the rest is served by the added slab.
+  for (std::size_t i = 7000; i < 64*128 + 512; ++i) {
+    held.push_back(std::make_exception_ptr(MyException()));
+  }
+  auto stats = __get_exception_memory_pool_elastic_statistics();
+  EXPECT_GE(stats.slabs, 1u);
+  EXPECT_LE(stats.slabs, std::size_t(EXCEPTION_MEMORY__CXX_ELASTIC_SLABS));
+  EXPECT_EQ(stats.capacity, 64*128 + stats.slabs * 1024);
+  EXPECT_EQ(stats.used_segments, held.size());
+  EXPECT_GE(stats.growth_requests, 1u);
+  EXPECT_EQ(stats.growth_failures, 0u);
+  EXPECT_GE(stats.allocations, 512u);
+  // The added slabs are part of the memory pool which is prefaulted and locked.
+  EXPECT_GT(exception_memory::prefault_and_lock().prefaulted_bytes, prefaulted);
+  munlockall();
+  held.clear();
+  stats = __get_exception_memory_pool_elastic_statistics();
+  EXPECT_EQ(stats.used_segments, 0u);
+  check_used_segments(0);
+#else
+  EXPECT_FALSE(exception_memory::start_elastic_growth());
+  const auto stats = __get_exception_memory_pool_elastic_statistics();
+  EXPECT_EQ(stats.slabs, 0u);
+  EXPECT_EQ(stats.capacity, 0u);
+#endif
+}
+
+#if EXCEPTION_MEMORY__CXX_THREAD_CACHE_SIZE > 0
+TEST(StaticExceptions, ThreadCacheHitRate) {
+  const auto before = __get_exception_memory_pool_thread_cache_statistics();
+  auto t = std::thread([](){
+    g_forbid_malloc = true;
+    for (std::size_t i = 0; i < 100; ++i) {
+      try {
+        throw MyException();
+      } catch(...) {
+      }
+    }
+    g_forbid_malloc = false;
+  });
+  t.join();
+  // The thread returned its cache on exit.
+  check_used_segments(0);
+  const auto after = __get_exception_memory_pool_thread_cache_statistics();
+  // Only the very first allocation refills the empty cache, afterwards the shared pool is not
+  // touched anymore.
+  EXPECT_EQ(after.allocate_misses - before.allocate_misses, 1u);
+  EXPECT_EQ(after.allocate_hits - before.allocate_hits, 99u);
+  EXPECT_EQ(after.free_misses - before.free_misses, 0u);
+  EXPECT_EQ(after.free_hits - before.free_hits, 100u);
+}
+#endif
+
+#if EXCEPTION_MEMORY__CXX_SHARDS > 0
+TEST(StaticExceptions, ShardStealing) {
+  const auto before = __get_exception_memory_pool_shard_statistics();
+  // Holds more exceptions than a single shard of the default pool provides.
+  auto t = std::thread([](){
+    recursive_except(64 * 128 / EXCEPTION_MEMORY__CXX_SHARDS + 8);
+  });
+  t.join();
+  check_used_segments(0);
+  const auto after = __get_exception_memory_pool_shard_statistics();
+  EXPECT_EQ(after.local_hits - before.local_hits, 64u * 128u / EXCEPTION_MEMORY__CXX_SHARDS);
+  EXPECT_EQ(after.steals - before.steals, 9u);
+}
+#endif
+
+#ifdef EXCEPTION_MEMORY__CXX_PER_CPU_FREELISTS
+TEST(StaticExceptions, PerCpuFreelists) {
+  const auto before = __get_exception_memory_pool_per_cpu_statistics();
+  for (std::size_t i = 0; i < 100; ++i) {
+    try {
+      throw MyException();
+    } catch(...) {
+    }
+  }
+  const auto after = __get_exception_memory_pool_per_cpu_statistics();
+  const auto local_hits = after.local_hits - before.local_hits;
+  EXPECT_EQ(local_hits + (after.refills - before.refills) + (after.steals - before.steals), 100u);
+  // Freed segments are reused on the same CPU, only migrations make the thread miss.
+  EXPECT_GE(local_hits, 90u);
+}
+#endif
+
+#if EXCEPTION_MEMORY__CXX_NUMA_NODES > 0
+TEST(StaticExceptions, NumaNodePreference) {
+  // Pretend every CPU belongs to node 1, so this also works on single node machines.
+  std::array<std::uint16_t, 1024> topology;
+  topology.fill(1);
+  exception_memory::set_numa_topology(topology.data(), topology.size());
+
+  const auto before = __get_exception_memory_pool_numa_statistics();
+  try {
+    throw MyException();
+  } catch(...) {
+    EXPECT_EQ(__get_exception_memory_pool_numa_used_segments(0), 0u);
+    EXPECT_EQ(__get_exception_memory_pool_numa_used_segments(1), 1u);
+  }
+  // Exhausts the partition of node 1, the remaining exceptions come from node 0.
+  recursive_except(64 * 128 / EXCEPTION_MEMORY__CXX_NUMA_NODES + 8);
+  const auto after = __get_exception_memory_pool_numa_statistics();
+  EXPECT_EQ(after.local_hits - before.local_hits, 1u + 64u * 128u / EXCEPTION_MEMORY__CXX_NUMA_NODES);
+  EXPECT_EQ(after.remote_hits - before.remote_hits, 9u);
+  EXPECT_EQ(after.bind_failures, 0u);
+
+  topology.fill(0);
+  exception_memory::set_numa_topology(topology.data(), topology.size());
+}
+#endif
+
 TEST(StaticExceptions, SharedLibraryClass) {
   g_forbid_malloc = true;
   SomeClass();